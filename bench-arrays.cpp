@@ -0,0 +1,162 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares reading cfg5 arrays and multi-value tags as separate keys/strings (one find()
+// per array element, or splitting a multi-value tag on commas) with CFG::array().
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// An array or multi-value tag in cfg.
+struct Array
+{
+    Slice<const char> section;
+    CFG::const_iterator entry;
+    bool multi_value;
+};
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-arrays ints.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    CFG cfg(filename);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    uint64_t build_ns = get_nsecs();
+    cfg.build_arrays();
+    build_ns = get_nsecs() - build_ns;
+
+    std::vector<Array> arrays;
+    size_t elements = 0;
+    for(size_t s = 0; s < cfg.section_count(); ++s)
+    {
+        for(auto entry = cfg.section_begin(s); entry != cfg.section_end(s); ++entry)
+        {
+            const auto values = cfg.array(*entry);
+            if(!values.empty())
+            {
+                const auto v = cfg.value(*entry);
+                const bool multi = memchr(v.ptr(), ',', v.size()) != nullptr;
+                arrays.push_back(Array{cfg.section_name(s), entry, multi});
+                elements += values.size();
+            }
+        }
+    }
+    if(arrays.empty())
+    {
+        std::cerr << "ERROR: no arrays in " << filename << std::endl;
+        return 1;
+    }
+
+    // Total size of values read, so the compiler can't skip reading them.
+    size_t separate_bytes = 0, array_bytes = 0;
+
+    // Without arrays: look up each element as a key, or split values on commas.
+    std::string element_key;
+    uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const Array& array: arrays)
+        {
+            const auto v = cfg.value(*array.entry);
+            if(array.multi_value)
+            {
+                const char* begin = v.ptr();
+                for(;;)
+                {
+                    const char* const comma =
+                        static_cast<const char*>(memchr(begin, ',', v.end() - begin));
+                    const char* end = comma == nullptr ? v.end() : comma;
+                    // Trim spaces around the value, like array() does.
+                    while(begin < end && (*begin == ' ' || *begin == '\t'))
+                    {
+                        ++begin;
+                    }
+                    while(end > begin && (end[-1] == ' ' || end[-1] == '\t'))
+                    {
+                        --end;
+                    }
+                    separate_bytes += end - begin;
+                    if(comma == nullptr)
+                    {
+                        break;
+                    }
+                    begin = comma + 1;
+                }
+                continue;
+            }
+            const auto name = cfg.key(*array.entry);
+            const size_t size = std::stoul(std::string(v.ptr(), v.size()));
+            for(size_t i = 1; i <= size; ++i)
+            {
+                element_key.assign(name.ptr(), name.size());
+                element_key += std::to_string(i);
+                const auto found = cfg.find(array.section, element_key);
+                separate_bytes += cfg.value(*found).size();
+            }
+        }
+    }
+    const uint64_t separate_ns = get_nsecs() - start;
+
+    start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const Array& array: arrays)
+        {
+            for(const auto& value: cfg.array(*array.entry))
+            {
+                array_bytes += value.size();
+            }
+        }
+    }
+    const uint64_t array_ns = get_nsecs() - start;
+
+    if(separate_bytes != array_bytes)
+    {
+        std::cerr << "ERROR: array() gives different values" << std::endl;
+        return 1;
+    }
+
+    const double reads = static_cast<double>(elements) * times;
+    std::cout << arrays.size() << " arrays/multi-value tags with " << elements
+              << " values, build_arrays() took " << build_ns / 1000 << " us\n"
+              << "Average per value over " << times << " reads of each array:\n"
+              << "\tseparate keys/strings: " << separate_ns / reads << " ns\n"
+              << "\tarray():               " << array_ns / reads << " ns\n";
+    return 0;
+}
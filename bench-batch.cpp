@@ -0,0 +1,132 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 find() with find_batch() at different batch sizes, for each index.
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Look up all keys times times with find(). Returns average ns per lookup.
+double bench_find(const CFG& cfg, const std::vector<Slice<const char>>& keys,
+                  const unsigned times)
+{
+    // Prevents the lookups from being optimized away.
+    size_t found = 0;
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const auto& key: keys)
+        {
+            found += cfg.find(key) != cfg.end();
+        }
+    }
+    const uint64_t total = get_nsecs() - start;
+    if(found != keys.size() * times)
+    {
+        std::cerr << "ERROR: some keys were not found" << std::endl;
+    }
+    return static_cast<double>(total) / (keys.size() * times);
+}
+
+/// Look up all keys times times with find_batch(), batch keys at a time. Returns average
+/// ns per lookup.
+double bench_batch(const CFG& cfg, const std::vector<Slice<const char>>& keys,
+                   const unsigned times, const size_t batch)
+{
+    std::vector<CFG::const_iterator> results(keys.size());
+    size_t found = 0;
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        const Slice<const Slice<const char>> all_keys(keys);
+        Slice<CFG::const_iterator> all_results(results);
+        for(size_t b = 0; b < keys.size(); b += batch)
+        {
+            const size_t size = std::min(batch, keys.size() - b);
+            cfg.find_batch(all_keys.subslice(b, size), all_results.subslice(b, size));
+        }
+        for(const auto& result: results)
+        {
+            found += result != cfg.end();
+        }
+    }
+    const uint64_t total = get_nsecs() - start;
+    if(found != keys.size() * times)
+    {
+        std::cerr << "ERROR: some keys were not found" << std::endl;
+    }
+    return static_cast<double>(total) / (keys.size() * times);
+}
+
+/// Print lookup times of find() and find_batch() with batch sizes 1/8/32/128.
+void report(const char* const name, const CFG& cfg, const std::vector<Slice<const char>>& keys,
+            const unsigned times)
+{
+    const double single = bench_find(cfg, keys, times);
+    std::cout << "\t" << name << ": find() " << single << " ns";
+    for(const size_t batch: {1, 8, 32, 128})
+    {
+        const double batched = bench_batch(cfg, keys, times, batch);
+        std::cout << ", batch " << batch << " " << batched << " ns ("
+                  << single / batched << "x)";
+    }
+    std::cout << "\n";
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-batch huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+
+    CFG cfg(filename);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    // Look keys up in random order so consecutive lookups don't share cache lines.
+    std::vector<Slice<const char>> keys;
+    keys.reserve(cfg.size());
+    for(auto& entry: cfg)
+    {
+        keys.push_back(cfg.key(entry));
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+
+    std::cout << cfg.size() << " keys, " << times << " lookups of each (ns per lookup):\n";
+    report("sorted      ", cfg, keys, times);
+    CFG hashed = cfg;
+    hashed.build_hash_index();
+    report("hash index  ", hashed, keys, times);
+    CFG frozen = cfg;
+    frozen.freeze();
+    report("perfect hash", frozen, keys, times);
+    return 0;
+}
@@ -0,0 +1,139 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 lookup speed with and without a Bloom filter (see bloom-filter.h) when
+// 0%, 50% and 95% of looked up keys are not in the file.
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Look up all keys times times. Returns average ns per lookup.
+double bench_lookups(const CFG& cfg, const std::vector<Slice<const char>>& keys,
+                     const unsigned times, const size_t expect_found)
+{
+    // Prevents the lookups from being optimized away.
+    size_t found = 0;
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const auto& key: keys)
+        {
+            found += cfg.find(key) != cfg.end();
+        }
+    }
+    const uint64_t total = get_nsecs() - start;
+    if(found != expect_found * times)
+    {
+        std::cerr << "ERROR: unexpected lookup results" << std::endl;
+    }
+    return static_cast<double>(total) / (keys.size() * times);
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-bloom huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+
+    CFG cfg(filename);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    std::vector<Slice<const char>> hits;
+    hits.reserve(cfg.size());
+    for(auto& entry: cfg)
+    {
+        hits.push_back(cfg.key(entry));
+    }
+    // Keys that are not in the file: existing keys with a suffix that can't be in a key.
+    std::vector<std::string> miss_strings;
+    miss_strings.reserve(hits.size());
+    for(const auto& key: hits)
+    {
+        miss_strings.push_back(std::string(key.ptr(), key.size()) + "=");
+    }
+
+    // Each index without and with a filter.
+    CFG configs[8] = {cfg, cfg, cfg, cfg, cfg, cfg, cfg, cfg};
+    const char* const names[4] = {"sorted (lower_bound)", "eytzinger           ",
+                                  "hash index          ", "perfect hash        "};
+    for(size_t c = 0; c < 8; c += 2)
+    {
+        for(CFG* const config: {&configs[c], &configs[c + 1]})
+        {
+            switch(c / 2)
+            {
+                case 1: config->build_eytzinger_index(); break;
+                case 2: config->build_hash_index();      break;
+                case 3: config->freeze();                break;
+                default: break;
+            }
+        }
+        configs[c + 1].build_bloom_filter();
+    }
+
+    std::mt19937 rng(42);
+    std::cout << cfg.size() << " keys, " << times << " lookups of each (average per lookup; "
+              << "the filter takes "
+              << static_cast<double>(configs[1].index_bytes()) / cfg.size()
+              << " bytes/key):\n";
+    for(const unsigned miss_percent: {0u, 50u, 95u})
+    {
+        // Random keys, miss_percent of them missing, in random order.
+        std::vector<Slice<const char>> keys;
+        size_t expect_found = 0;
+        std::uniform_int_distribution<size_t> pick(0, hits.size() - 1);
+        std::uniform_int_distribution<unsigned> percent(0, 99);
+        for(size_t k = 0; k < hits.size(); ++k)
+        {
+            const size_t i = pick(rng);
+            if(percent(rng) < miss_percent)
+            {
+                keys.push_back(Slice<const char>(miss_strings[i]));
+            }
+            else
+            {
+                keys.push_back(hits[i]);
+                ++expect_found;
+            }
+        }
+
+        std::cout << miss_percent << "% misses:\n";
+        for(size_t c = 0; c < 8; c += 2)
+        {
+            std::cout << "\t" << names[c / 2] << ": "
+                      << bench_lookups(configs[c], keys, times, expect_found)
+                      << " ns, with filter "
+                      << bench_lookups(configs[c + 1], keys, times, expect_found) << " ns\n";
+        }
+    }
+    return 0;
+}
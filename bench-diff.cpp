@@ -0,0 +1,127 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares finding keys added, removed or changed between two versions of a config: with
+// diff() (see config-diff.h) and by iterating each CFG and calling find() on the other.
+
+#include <iostream>
+#include <string>
+
+#include "config-diff.h"
+#include "diy.h"
+
+
+/// Numbers of added, removed and changed keys.
+struct Counts
+{
+    size_t added;
+    size_t removed;
+    size_t changed;
+
+    bool operator==(const Counts& rhs) const
+    {
+        return added == rhs.added && removed == rhs.removed && changed == rhs.changed;
+    }
+};
+
+/// Count differences by looking up every key of each CFG in the other one.
+Counts diff_find(const CFG& old_cfg, const CFG& new_cfg)
+{
+    Counts counts{0, 0, 0};
+    for(size_t s = 0; s < old_cfg.section_count(); ++s)
+    {
+        const auto section = old_cfg.section_name(s);
+        for(auto entry = old_cfg.section_begin(s); entry != old_cfg.section_end(s); ++entry)
+        {
+            const auto found = new_cfg.find(section, old_cfg.key(*entry));
+            if(found == new_cfg.end())
+            {
+                ++counts.removed;
+            }
+            else if(!(new_cfg.value(*found) == old_cfg.value(*entry)))
+            {
+                ++counts.changed;
+            }
+        }
+    }
+    for(size_t s = 0; s < new_cfg.section_count(); ++s)
+    {
+        const auto section = new_cfg.section_name(s);
+        for(auto entry = new_cfg.section_begin(s); entry != new_cfg.section_end(s); ++entry)
+        {
+            counts.added += old_cfg.find(section, new_cfg.key(*entry)) == old_cfg.end();
+        }
+    }
+    return counts;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 4)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-diff huge.cfg huge-edited.cfg 20" << std::endl;
+        return 1;
+    }
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[3]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: third arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: third arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    const CFG old_cfg(argv[1]);
+    const CFG new_cfg(argv[2]);
+    if(!old_cfg.is_valid() || !new_cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse " << argv[1] << " or " << argv[2]
+                  << std::endl;
+        return 1;
+    }
+
+    uint64_t find_ns = 0, diff_ns = 0;
+    Counts by_find{0, 0, 0}, by_diff{0, 0, 0};
+    for(unsigned t = 0; t < times; ++t)
+    {
+        uint64_t start = get_nsecs();
+        by_find = diff_find(old_cfg, new_cfg);
+        find_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        by_diff = Counts{0, 0, 0};
+        diff(old_cfg, new_cfg, [&by_diff](const Change& change) {
+            switch(change.kind)
+            {
+                case ChangeKind::ADDED:   ++by_diff.added;   break;
+                case ChangeKind::REMOVED: ++by_diff.removed; break;
+                case ChangeKind::CHANGED: ++by_diff.changed; break;
+            }
+        });
+        diff_ns += get_nsecs() - start;
+    }
+
+    if(!(by_find == by_diff))
+    {
+        std::cerr << "ERROR: diff() and find() found different changes" << std::endl;
+        return 1;
+    }
+
+    std::cout << old_cfg.size() << " -> " << new_cfg.size() << " entries: "
+              << by_diff.added << " added, " << by_diff.removed << " removed, "
+              << by_diff.changed << " changed\n"
+              << "\tfind(): " << find_ns / times / 1000 << " us\n"
+              << "\tdiff(): " << diff_ns / times / 1000 << " us\n";
+    return 0;
+}
@@ -0,0 +1,121 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 lookup speed with different indices.
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Look up all keys times times. Returns average ns per lookup.
+double bench_lookups(const CFG& cfg, const std::vector<Slice<const char>>& keys,
+                     const unsigned times, const bool expect_found)
+{
+    // Prevents the lookups from being optimized away.
+    size_t found = 0;
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const auto& key: keys)
+        {
+            found += cfg.find(key) != cfg.end();
+        }
+    }
+    const uint64_t total = get_nsecs() - start;
+    if(found != (expect_found ? keys.size() * times : 0))
+    {
+        std::cerr << "ERROR: unexpected lookup results" << std::endl;
+    }
+    return static_cast<double>(total) / (keys.size() * times);
+}
+
+/// Print lookup times of an index.
+void report(const char* const name, const CFG& cfg, const uint64_t build_ns,
+            const size_t bytes, const std::vector<Slice<const char>>& hits,
+            const std::vector<Slice<const char>>& misses, const unsigned times)
+{
+    std::cout << "\t" << name << ": hit " << bench_lookups(cfg, hits, times, true)
+              << " ns, miss " << bench_lookups(cfg, misses, times, false) << " ns, "
+              << static_cast<double>(bytes) / cfg.size() << " bytes/key, built in "
+              << build_ns / 1000 << " us\n";
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-find huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+
+    CFG cfg(filename);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    // Look keys up in random order so consecutive lookups don't share cache lines.
+    std::vector<Slice<const char>> hits;
+    hits.reserve(cfg.size());
+    for(auto& entry: cfg)
+    {
+        hits.push_back(cfg.key(entry));
+    }
+    std::shuffle(hits.begin(), hits.end(), std::mt19937(42));
+
+    // Keys that are not in the file: existing keys with a suffix that can't be in a key.
+    std::vector<std::string> miss_strings;
+    miss_strings.reserve(hits.size());
+    for(const auto& key: hits)
+    {
+        miss_strings.push_back(std::string(key.ptr(), key.size()) + "=");
+    }
+    std::vector<Slice<const char>> misses(miss_strings.begin(), miss_strings.end());
+
+    std::cout << cfg.size() << " keys, " << times << " lookups of each (average per lookup"
+              << "; bytes/key do not include the entries themselves):\n";
+
+    report("sorted (lower_bound)", cfg, 0, 0, hits, misses, times);
+
+    CFG eytzinger = cfg;
+    uint64_t start = get_nsecs();
+    eytzinger.build_eytzinger_index();
+    report("eytzinger           ", eytzinger, get_nsecs() - start, eytzinger.index_bytes(),
+           hits, misses, times);
+
+    CFG hashed = cfg;
+    start = get_nsecs();
+    hashed.build_hash_index();
+    report("hash index          ", hashed, get_nsecs() - start, hashed.index_bytes(),
+           hits, misses, times);
+
+    CFG frozen = cfg;
+    start = get_nsecs();
+    frozen.freeze();
+    report("perfect hash        ", frozen, get_nsecs() - start, frozen.index_bytes(),
+           hits, misses, times);
+    return 0;
+}
@@ -0,0 +1,166 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares converting cfg5 values with std::stoll()/std::stod() on every access with
+// CFG::get(), which parses each value once and caches the result.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Convert a value the way code without get() would.
+bool std_convert(const Slice<const char> value, int64_t& result)
+{
+    result = std::stoll(std::string(value.ptr(), value.size()));
+    return true;
+}
+
+bool std_convert(const Slice<const char> value, double& result)
+{
+    result = std::stod(std::string(value.ptr(), value.size()));
+    return true;
+}
+
+bool std_convert(const Slice<const char> value, bool& result)
+{
+    const std::string str(value.ptr(), value.size());
+    result = str == "yes" || str == "true" || str == "1";
+    return result || str == "no" || str == "false" || str == "0";
+}
+
+/// Read all values of cfg as T times times, with std_convert() and with get().
+template<typename T>
+int bench(const CFG& cfg, const unsigned times)
+{
+    // Sums of values, so the compiler can't skip conversions.
+    double std_sum = 0.0, first_sum = 0.0, cached_sum = 0.0;
+
+    uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const auto& entry: cfg)
+        {
+            T value;
+            if(!std_convert(cfg.value(entry), value))
+            {
+                std::cerr << "ERROR: value is not of the requested type" << std::endl;
+                return 1;
+            }
+            std_sum += value;
+        }
+    }
+    const uint64_t std_ns = get_nsecs() - start;
+
+    // First get() of each value parses it...
+    start = get_nsecs();
+    for(const auto& entry: cfg)
+    {
+        T value;
+        if(!cfg.get(entry, value))
+        {
+            std::cerr << "ERROR: value is not of the requested type" << std::endl;
+            return 1;
+        }
+        first_sum += value;
+    }
+    const uint64_t first_ns = get_nsecs() - start;
+
+    // ...later ones are cached.
+    start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(const auto& entry: cfg)
+        {
+            T value;
+            cfg.get(entry, value);
+            cached_sum += value;
+        }
+    }
+    const uint64_t cached_ns = get_nsecs() - start;
+
+    // Check that both give the same values (summing in the same order as the first get()).
+    double std_once_sum = 0.0;
+    for(const auto& entry: cfg)
+    {
+        T std_value, value;
+        std_convert(cfg.value(entry), std_value);
+        cfg.get(entry, value);
+        std_once_sum += std_value;
+        if(std_value != value)
+        {
+            std::cerr << "ERROR: get() and std conversion results differ" << std::endl;
+            return 1;
+        }
+    }
+    if(std_once_sum != first_sum || std_sum != cached_sum)
+    {
+        std::cerr << "ERROR: get() and std conversion results differ" << std::endl;
+        return 1;
+    }
+
+    const double values = static_cast<double>(cfg.size());
+    std::cout << "Average per value, " << cfg.size() << " values:\n"
+              << "\tstd conversion:        " << std_ns / (values * times) << " ns\n"
+              << "\tget(), first access:   " << first_ns / values << " ns\n"
+              << "\tget(), cached:         " << cached_ns / (values * times) << " ns\n";
+    return 0;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 4)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-get ints.cfg 20 int" << std::endl;
+        std::cerr << "(third arg is the value type: int, float or bool)" << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    const std::string type = argv[3];
+
+    const CFG cfg(filename);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    if(type == "int")
+    {
+        return bench<int64_t>(cfg, times);
+    }
+    if(type == "float")
+    {
+        return bench<double>(cfg, times);
+    }
+    if(type == "bool")
+    {
+        return bench<bool>(cfg, times);
+    }
+    std::cerr << "ERROR: third arg must be int, float or bool" << std::endl;
+    return 1;
+}
@@ -0,0 +1,191 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares reading a few hundred hot keys of a config by find() with reading them by
+// KeyId (see key-table.h), and times re-resolving KeyIds after a reload.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "diy.h"
+#include "key-table.h"
+
+
+/// Number of hot keys.
+const size_t HOT_KEYS = 300;
+
+/// Find a key passed as a std::string by value, like cfg.h does.
+CFG::const_iterator find_copy(const CFG& cfg, const std::string key)
+{
+    return cfg.find(Slice<const char>(key));
+}
+
+/// Read values of all keys times times with read(k), which returns the value of key k.
+/// Returns average ns per read.
+template<typename Read>
+double bench_reads(const size_t keys, const unsigned times, const Read& read)
+{
+    // Prevents the reads from being optimized away.
+    size_t sum = 0;
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; ++t)
+    {
+        for(size_t k = 0; k < keys; ++k)
+        {
+            sum += read(k).size();
+        }
+    }
+    const uint64_t total = get_nsecs() - start;
+    if(sum == 0)
+    {
+        std::cerr << "ERROR: read nothing" << std::endl;
+    }
+    return static_cast<double>(total) / (keys * times);
+}
+
+/// Write text to file. Returns false on error.
+bool write_file(const std::string& file, const std::string& text)
+{
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(text.data(), text.size());
+    return out.good();
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-keys huge.cfg 10000 " << std::endl;
+        std::cerr << "(writes edited versions to huge.cfg.edit)" << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+    const std::string edited   = std::string(filename) + ".edit";
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    CFG cfg(filename);
+    if(!cfg.is_valid() || cfg.section_end(0) == cfg.section_begin(0))
+    {
+        std::cerr << "ERROR: Failed to open or parse file, or no keys outside sections: "
+                  << filename << std::endl;
+        return 1;
+    }
+    CFG hashed = cfg;
+    hashed.build_hash_index();
+
+    // Random hot keys of the unnamed section.
+    std::vector<std::string> hot;
+    std::mt19937 rng(42);
+    const size_t root_keys = cfg.section_end(0) - cfg.begin();
+    std::uniform_int_distribution<size_t> pick(0, root_keys - 1);
+    KeyTable table;
+    while(hot.size() < HOT_KEYS && hot.size() < root_keys)
+    {
+        const auto key = cfg.key(*(cfg.begin() + pick(rng)));
+        if(table.intern(key) == hot.size())
+        {
+            hot.push_back(std::string(key.ptr(), key.size()));
+        }
+    }
+    table.resolve(cfg);
+
+    std::cout << hot.size() << " hot keys, each read " << times << " times "
+              << "(average per read):\n"
+              << "\tfind(std::string by value): " << bench_reads(hot.size(), times,
+                 [&](const size_t k) { return cfg.value(*find_copy(cfg, hot[k])); })
+              << " ns\n"
+              << "\tfind(Slice):                " << bench_reads(hot.size(), times,
+                 [&](const size_t k) {
+                     return cfg.value(*cfg.find(Slice<const char>(hot[k])));
+                 })
+              << " ns\n"
+              << "\tfind(Slice), hash index:    " << bench_reads(hot.size(), times,
+                 [&](const size_t k) {
+                     return hashed.value(*hashed.find(Slice<const char>(hot[k])));
+                 })
+              << " ns\n"
+              << "\tat(KeyId):                  " << bench_reads(hot.size(), times,
+                 [&](const size_t k) {
+                     return cfg.value(*cfg.at(table.id(static_cast<KeyTable::Key>(k))));
+                 })
+              << " ns\n";
+
+    // Reloads: with a changed value (keys stay where they were) and with an added key
+    // (most keys move by one).
+    std::string text;
+    {
+        std::ifstream file(filename, std::ios::binary);
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    const Entry& changed = *(cfg.begin() + pick(rng));
+    std::string value_changed = text;
+    value_changed.insert(changed.value.offset + changed.value.length, "x");
+    std::string key_added = "!added = 1\n" + text;
+
+    std::cout << "resolve() of " << hot.size() << " keys:\n";
+    for(const std::string* const version: {&value_changed, &key_added})
+    {
+        if(!write_file(edited, *version))
+        {
+            std::cerr << "ERROR: Failed to write " << edited << std::endl;
+            return 1;
+        }
+        const CFG reloaded(edited);
+        if(!reloaded.is_valid())
+        {
+            std::cerr << "ERROR: Failed to parse " << edited << std::endl;
+            return 1;
+        }
+        KeyTable resolved = table;
+        // A new table has no IDs to start from.
+        KeyTable fresh;
+        for(const auto& key: hot)
+        {
+            fresh.intern(Slice<const char>(key));
+        }
+
+        uint64_t start = get_nsecs();
+        const size_t fresh_lookups = fresh.resolve(reloaded);
+        const uint64_t fresh_ns = get_nsecs() - start;
+        start = get_nsecs();
+        const size_t lookups = resolved.resolve(reloaded);
+        const uint64_t resolved_ns = get_nsecs() - start;
+
+        for(KeyTable::Key k = 0; k < hot.size(); ++k)
+        {
+            if(resolved.id(k) != fresh.id(k) || resolved.id(k) == CFG::NO_KEY)
+            {
+                std::cerr << "ERROR: resolve() found a different entry" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "\t" << (version == &value_changed ? "value changed:" : "key added:    ")
+                  << " new table " << fresh_ns / 1000.0 << " us (" << fresh_lookups
+                  << " lookups), re-resolved " << resolved_ns / 1000.0 << " us ("
+                  << lookups << " lookups)\n";
+    }
+    return 0;
+}
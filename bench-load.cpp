@@ -0,0 +1,75 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares CFG loaders (std::ifstream vs mmap()) of cfg5 on the same file.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Parse filename times times with specified loader, return the average time in ns.
+uint64_t bench_loader(const char* const filename, const unsigned times, const Loader loader)
+{
+    uint64_t total = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        const uint64_t start = get_nsecs();
+        CFG cfg(filename, loader);
+        total += get_nsecs() - start;
+
+        if(!cfg.is_valid())
+        {
+            std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+            return 0;
+        }
+    }
+    return total / times;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-load huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    // Warm up the page cache so neither loader pays for reading from disk.
+    bench_loader(filename, 1, Loader::IFSTREAM);
+    const uint64_t ifstream_ns = bench_loader(filename, times, Loader::IFSTREAM);
+    const uint64_t mmap_ns     = bench_loader(filename, times, Loader::MMAP);
+    if(ifstream_ns == 0 || mmap_ns == 0)
+    {
+        return 1;
+    }
+
+    std::cout << "Average parse time over " << times << " runs:\n"
+              << "\tifstream: " << ifstream_ns / 1000 << " us\n"
+              << "\tmmap:     " << mmap_ns / 1000 << " us\n";
+    return 0;
+}
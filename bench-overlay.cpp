@@ -0,0 +1,195 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares ways to combine several config layers (defaults, then overrides): copying all
+// entries into a std::map, a ConfigOverlay (see config-overlay.h), and a ConfigOverlay
+// flattened into one CFG.
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config-overlay.h"
+#include "diy.h"
+
+
+typedef std::map<std::pair<std::string, std::string>, std::string> MergedMap;
+
+/// Merge layers by copying entries into a map, higher layers overwriting lower ones.
+MergedMap merge_copy(const std::vector<std::unique_ptr<CFG>>& layers)
+{
+    MergedMap merged;
+    for(const auto& layer: layers)
+    {
+        for(size_t s = 0; s < layer->section_count(); ++s)
+        {
+            const auto name = layer->section_name(s);
+            const std::string section(name.ptr(), name.size());
+            for(auto e = layer->section_begin(s); e != layer->section_end(s); ++e)
+            {
+                const auto k = layer->key(*e);
+                const auto v = layer->value(*e);
+                merged[std::make_pair(section, std::string(k.ptr(), k.size()))] =
+                    std::string(v.ptr(), v.size());
+            }
+        }
+    }
+    return merged;
+}
+
+/// Look up (section, key) in an overlay or a CFG, using the index of the unnamed section.
+template<typename Config>
+auto find_in(const Config& config, const std::pair<std::string, std::string>& key)
+    -> decltype(config.find(Slice<const char>(key.second)))
+{
+    const Slice<const char> k(key.second);
+    return key.first.empty() ? config.find(k) : config.find(Slice<const char>(key.first), k);
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-overlay 20 huge.cfg huge-env.cfg huge-host.cfg"
+                  << std::endl;
+        std::cerr << "(20 runs; layers from the bottom to the top)" << std::endl;
+        return 1;
+    }
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[1]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: first arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: first arg must not be zero" << std::endl;
+        return 1;
+    }
+    if(argc - 2 > static_cast<int>(ConfigOverlay::MAX_LAYERS))
+    {
+        std::cerr << "ERROR: at most " << ConfigOverlay::MAX_LAYERS << " layers" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<CFG>> layers;
+    for(int a = 2; a < argc; ++a)
+    {
+        layers.emplace_back(new CFG(argv[a]));
+        if(!layers.back()->is_valid())
+        {
+            std::cerr << "ERROR: Failed to open or parse file " << argv[a] << std::endl;
+            return 1;
+        }
+        layers.back()->build_hash_index();
+    }
+
+    // The reference result; also gives us the keys to look up.
+    const MergedMap reference = merge_copy(layers);
+    std::vector<std::pair<std::string, std::string>> keys;
+    for(const auto& pair: reference)
+    {
+        keys.push_back(pair.first);
+    }
+
+    uint64_t copy_build_ns = 0, copy_find_ns = 0;
+    uint64_t overlay_build_ns = 0, overlay_find_ns = 0, overlay_iterate_ns = 0;
+    uint64_t flat_build_ns = 0, flat_find_ns = 0;
+    size_t sum = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        uint64_t start = get_nsecs();
+        const MergedMap merged = merge_copy(layers);
+        copy_build_ns += get_nsecs() - start;
+        start = get_nsecs();
+        for(const auto& key: keys)
+        {
+            sum += merged.find(key)->second.size();
+        }
+        copy_find_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        ConfigOverlay overlay;
+        for(const auto& layer: layers)
+        {
+            overlay.push(*layer);
+        }
+        overlay_build_ns += get_nsecs() - start;
+        start = get_nsecs();
+        for(const auto& key: keys)
+        {
+            sum += find_in(overlay, key).value().size();
+        }
+        overlay_find_ns += get_nsecs() - start;
+        start = get_nsecs();
+        for(const auto entry: overlay)
+        {
+            sum += entry.value().size();
+        }
+        overlay_iterate_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        const CFG flat = overlay.flatten();
+        flat_build_ns += get_nsecs() - start;
+        start = get_nsecs();
+        for(const auto& key: keys)
+        {
+            sum += flat.value(*find_in(flat, key)).size();
+        }
+        flat_find_ns += get_nsecs() - start;
+    }
+
+    // Check that all three agree with the reference.
+    ConfigOverlay overlay;
+    for(const auto& layer: layers)
+    {
+        overlay.push(*layer);
+    }
+    const CFG flat = overlay.flatten();
+    auto ref = reference.begin();
+    auto flat_entry = flat.begin();
+    for(const auto entry: overlay)
+    {
+        const auto section = entry.section;
+        const auto k = entry.key();
+        const auto v = entry.value();
+        if(ref == reference.end() || flat_entry == flat.end() ||
+           !(Slice<const char>(ref->first.first) == section) ||
+           !(Slice<const char>(ref->first.second) == k) ||
+           !(Slice<const char>(ref->second) == v) ||
+           !(flat.key(*flat_entry) == k) || !(flat.value(*flat_entry) == v))
+        {
+            std::cerr << "ERROR: overlay differs from merged copy" << std::endl;
+            return 1;
+        }
+        ++ref;
+        ++flat_entry;
+    }
+    if(ref != reference.end() || flat_entry != flat.end())
+    {
+        std::cerr << "ERROR: overlay differs from merged copy" << std::endl;
+        return 1;
+    }
+
+    std::cout << layers.size() << " layers, " << keys.size() << " keys (checksum " << sum
+              << "), average of " << times << " runs:\n"
+              << "\tcopy to std::map: build " << copy_build_ns / times / 1000
+              << " us, find all " << copy_find_ns / times / 1000 << " us\n"
+              << "\tConfigOverlay:    build " << overlay_build_ns / times / 1000
+              << " us, find all " << overlay_find_ns / times / 1000 << " us, iterate "
+              << overlay_iterate_ns / times / 1000 << " us\n"
+              << "\tflatten():        build " << flat_build_ns / times / 1000
+              << " us, find all " << flat_find_ns / times / 1000 << " us\n";
+    return 0;
+}
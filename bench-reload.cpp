@@ -0,0 +1,187 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 lookups from many threads while another thread keeps reloading the file:
+// through a ConfigHandle (lock-free reads, see config-handle.h) and through a CFG
+// protected by a std::mutex.
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "config-handle.h"
+#include "diy.h"
+
+
+/// Results of one benchmark run.
+struct Result
+{
+    // Total lookups by all readers, and lookups that didn't find their key.
+    size_t lookups;
+    size_t missing;
+    // Time of the whole run (all reloads).
+    uint64_t total_ns;
+};
+
+/** Run readers threads looking up keys while the calling thread reloads filename times
+ * times.
+ *
+ * find   = find(reader, key) looks up a key; returns true if found. reader is the
+ *          number of the reader thread.
+ * reload = Reloads the file. Returns false on error.
+ */
+template<typename Find, typename Reload>
+Result bench(const std::vector<std::string>& keys, const unsigned times,
+             const unsigned readers, const Find& find, const Reload& reload)
+{
+    std::atomic<bool> done(false);
+    std::vector<size_t> lookups(readers + 1), missing(readers + 1);
+    const uint64_t start = get_nsecs();
+    run_parallel(readers + 1, [&](const unsigned r) {
+        if(r == 0)
+        {
+            for(unsigned t = 0; t < times; ++t)
+            {
+                if(!reload())
+                {
+                    std::cerr << "ERROR: reload failed" << std::endl;
+                }
+            }
+            done.store(true);
+            return;
+        }
+        // Each reader starts at a different key. Counters are local until the end so
+        // readers don't write to shared cache lines.
+        size_t k = keys.size() * r / (readers + 1);
+        size_t reader_lookups = 0, reader_missing = 0;
+        while(!done.load(std::memory_order_relaxed))
+        {
+            for(unsigned i = 0; i < 256; ++i)
+            {
+                reader_missing += !find(r, keys[k]);
+                k = k + 1 == keys.size() ? 0 : k + 1;
+            }
+            reader_lookups += 256;
+        }
+        lookups[r] = reader_lookups;
+        missing[r] = reader_missing;
+    });
+    Result result{0, 0, get_nsecs() - start};
+    for(unsigned r = 1; r <= readers; ++r)
+    {
+        result.lookups += lookups[r];
+        result.missing += missing[r];
+    }
+    return result;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 4)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-reload huge.cfg 20 4" << std::endl;
+        std::cerr << "(20 reloads, 4 reader threads)" << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times, readers;
+    try
+    {
+        times   = std::stoul(argv[2]);
+        readers = std::stoul(argv[3]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second and third arg must be numbers" << std::endl;
+        return 1;
+    }
+    if(times == 0 || readers == 0)
+    {
+        std::cerr << "ERROR: second and third arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    CFG initial(filename);
+    if(!initial.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+    // Copies of keys: keys of a CFG are freed with it when it's reloaded.
+    std::vector<std::string> keys;
+    for(auto entry = initial.section_begin(0); entry != initial.section_end(0); ++entry)
+    {
+        const auto key = initial.key(*entry);
+        keys.push_back(std::string(key.ptr(), key.size()));
+    }
+    if(keys.empty())
+    {
+        std::cerr << "ERROR: no keys outside sections in " << filename << std::endl;
+        return 1;
+    }
+
+    // Lock-free reads through a ConfigHandle.
+    ConfigHandle handle(initial);
+    size_t max_retired = 0;
+    Result lock_free;
+    {
+        std::vector<std::unique_ptr<ConfigHandle::Reader>> handle_readers;
+        for(unsigned r = 0; r <= readers; ++r)
+        {
+            handle_readers.emplace_back(new ConfigHandle::Reader(handle));
+        }
+        lock_free = bench(keys, times, readers,
+            [&](const unsigned r, const std::string& key) {
+                const ConfigHandle::Guard cfg(*handle_readers[r]);
+                return cfg->find(Slice<const char>(key)) != cfg->end();
+            },
+            [&]() {
+                const bool reloaded = handle.reload(filename);
+                max_retired = std::max(max_retired, handle.retired_count());
+                return reloaded;
+            });
+    }
+
+    // Reads of a CFG protected by a mutex; reload() parses first, then locks to swap.
+    std::mutex mutex;
+    CFG locked_cfg(initial);
+    const Result locked = bench(keys, times, readers,
+        [&](const unsigned, const std::string& key) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return locked_cfg.find(Slice<const char>(key)) != locked_cfg.end();
+        },
+        [&]() {
+            CFG cfg(filename);
+            std::lock_guard<std::mutex> lock(mutex);
+            locked_cfg = std::move(cfg);
+            return locked_cfg.is_valid();
+        });
+
+    if(lock_free.missing != 0 || locked.missing != 0)
+    {
+        std::cerr << "ERROR: some keys were not found" << std::endl;
+        return 1;
+    }
+
+    // Lookups per millisecond of all readers together.
+    const auto throughput = [](const Result& result) {
+        return result.lookups * 1000000.0 / result.total_ns;
+    };
+    std::cout << times << " reloads of " << keys.size() << " keys with " << readers
+              << " reader threads:\n"
+              << "\tConfigHandle: " << throughput(lock_free) << " lookups/ms, reloads took "
+              << lock_free.total_ns / 1000 << " us, at most " << max_retired
+              << " old CFGs kept alive\n"
+              << "\tstd::mutex:   " << throughput(locked) << " lookups/ms, reloads took "
+              << locked.total_ns / 1000 << " us\n";
+    return 0;
+}
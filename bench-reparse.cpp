@@ -0,0 +1,140 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares a full cfg5 parse with CFG::reparse() after editing a single line of a file.
+// Each run changes the value of a random entry and saves the file as FILE.edit. Files are
+// mapped (Loader::MMAP) so both only pay for parsing, not for copying the file.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Are two CFGs the same, down to offsets of keys and values in their text?
+bool same(const CFG& a, const CFG& b)
+{
+    if(a.size() != b.size() || a.section_count() != b.section_count())
+    {
+        return false;
+    }
+    for(size_t s = 0; s < a.section_count(); ++s)
+    {
+        if(!(a.section_name(s) == b.section_name(s)) ||
+           a.section_begin(s) - a.begin() != b.section_begin(s) - b.begin())
+        {
+            return false;
+        }
+    }
+    auto eb = b.begin();
+    for(auto ea = a.begin(); ea != a.end(); ++ea, ++eb)
+    {
+        if(ea->prefix != eb->prefix || ea->key.offset != eb->key.offset ||
+           ea->key.length != eb->key.length || ea->value.offset != eb->value.offset ||
+           ea->value.length != eb->value.length)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-reparse 1m.cfg 20 " << std::endl;
+        std::cerr << "(writes edited versions to 1m.cfg.edit)" << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+    const std::string edited   = std::string(filename) + ".edit";
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    CFG current(filename, Loader::MMAP);
+    if(!current.is_valid() || current.size() == 0)
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+    // The text we edit, always the same as the text of current.
+    std::string text;
+    {
+        std::ifstream file(filename, std::ios::binary);
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::mt19937 rng(42);
+    uint64_t full_ns = 0, reparse_ns = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        // Change the last character of a random value (or give it one if empty).
+        std::uniform_int_distribution<size_t> pick(0, current.size() - 1);
+        const Entry& entry = *(current.begin() + pick(rng));
+        const size_t value_end = entry.value.offset + entry.value.length;
+        if(entry.value.length == 0)
+        {
+            text.insert(value_end, 1, 'x');
+        }
+        else
+        {
+            char& last = text[value_end - 1];
+            last = last == 'x' ? 'y' : 'x';
+        }
+        // Replace the file instead of rewriting it: current still has the old one mapped.
+        {
+            std::ofstream file(edited + ".tmp", std::ios::binary | std::ios::trunc);
+            file.write(text.data(), text.size());
+        }
+        if(std::rename((edited + ".tmp").c_str(), edited.c_str()) != 0)
+        {
+            std::cerr << "ERROR: Failed to write " << edited << std::endl;
+            return 1;
+        }
+
+        uint64_t start = get_nsecs();
+        const CFG full(edited, Loader::MMAP);
+        full_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        CFG reparsed = current.reparse(edited, Loader::MMAP);
+        reparse_ns += get_nsecs() - start;
+
+        if(!full.is_valid() || !reparsed.is_valid() || !same(full, reparsed))
+        {
+            std::cerr << "ERROR: reparse() differs from a full parse" << std::endl;
+            return 1;
+        }
+        current = std::move(reparsed);
+    }
+
+    std::cout << current.size() << " entries, average over " << times
+              << " single-line edits:\n"
+              << "\tfull parse: " << full_ns / times / 1000 << " us\n"
+              << "\treparse():  " << reparse_ns / times / 1000 << " us\n";
+    return 0;
+}
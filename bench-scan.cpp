@@ -0,0 +1,142 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures throughput of the line scanner (scan.h) with each instruction set, and checks
+// that they all give the same results and tell [section] headers from entries.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Scan text times times using isa. Puts scanned entries to entries, returns average ns.
+uint64_t bench_isa(const Text& text, const unsigned times, const Isa isa,
+                   std::vector<Entry>& entries)
+{
+    uint64_t total = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        entries.clear();
+        const char* const data = text.data();
+        const auto add_entry = [&entries, data](const Span key, const Span value) {
+            entries.push_back(make_entry(data, key, value));
+        };
+        Span error;
+        const uint64_t start = get_nsecs();
+        scan_lines(text.data(), text.size(), add_entry, error, isa);
+        total += get_nsecs() - start;
+    }
+    return total / times;
+}
+
+/// Check that isa scans lines that look like [section] headers as expected.
+bool check_headers(const Isa isa)
+{
+    // Lines longer than a window (64 bytes) are scanned by scan_line_scalar().
+    const std::string long_name(70, 'x');
+    const struct
+    {
+        std::string line;
+        bool valid;
+        size_t sections;
+        size_t entries;
+    } cases[] = {{"[x]", true, 1, 0},
+                 {"  [ x ]  # comment", true, 1, 0},
+                 {"x = [y]", true, 0, 1},
+                 {"[x = y", true, 0, 1},
+                 {"[x]=[y]", true, 0, 1},
+                 {"[x] = y", true, 0, 1},
+                 {"[" + long_name + "]", true, 1, 0},
+                 {"[" + long_name + "]=[y]", true, 0, 1},
+                 {"[x", false, 0, 0}};
+    for(const auto& c: cases)
+    {
+        const std::string text = c.line + "\n";
+        size_t sections = 0, entries = 0;
+        const auto add_entry   = [&entries](const Span, const Span) { ++entries; };
+        const auto add_section = [&sections](const Span) { ++sections; return true; };
+        Span error;
+        const bool valid = scan_lines(text.data(), text.size(), add_entry, add_section,
+                                      error, isa);
+        if(valid != c.valid || sections != c.sections || entries != c.entries)
+        {
+            std::cerr << "ERROR: wrong scan of line '" << c.line << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-scan huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    Text text;
+    if(!text.load(filename, Loader::IFSTREAM))
+    {
+        std::cerr << "ERROR: Failed to open file " << filename << std::endl;
+        return 1;
+    }
+
+    const Isa isas[]         = {Isa::SCALAR, Isa::SSE2, Isa::AVX2};
+    const char* const names[] = {"scalar", "sse2  ", "avx2  "};
+    std::vector<Entry> reference;
+    std::cout << "Scanning " << text.size() << " bytes, average of " << times << " runs:\n";
+    for(size_t i = 0; i < 3; ++i)
+    {
+        if(!check_headers(isas[i]))
+        {
+            std::cerr << "(with " << names[i] << ")" << std::endl;
+            return 1;
+        }
+        std::vector<Entry> entries;
+        const uint64_t ns = bench_isa(text, times, isas[i], entries);
+        std::cout << "\t" << names[i] << ": " << ns / 1000 << " us, "
+                  << static_cast<double>(text.size()) / ns << " GB/s\n";
+        if(i == 0)
+        {
+            reference.swap(entries);
+            continue;
+        }
+        // All instruction sets must give the same results.
+        if(entries.size() != reference.size() ||
+           0 != memcmp(entries.data(), reference.data(), entries.size() * sizeof(Entry)))
+        {
+            std::cerr << "ERROR: " << names[i] << " results differ from scalar" << std::endl;
+            return 1;
+        }
+    }
+    if(best_isa() != Isa::AVX2)
+    {
+        std::cout << "(no AVX2 on this CPU; avx2 ran as sse2)\n";
+    }
+    return 0;
+}
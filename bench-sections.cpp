@@ -0,0 +1,114 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 find(section, key) (section table, then a binary search of one section)
+// with a binary search of one global sorted array of "section.key" strings.
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-sections sections.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    uint64_t parse_ns = get_nsecs();
+    const CFG cfg(filename);
+    parse_ns = get_nsecs() - parse_ns;
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+
+    // Section names and keys of all entries, and the same as "section.key" strings.
+    std::vector<Slice<const char>> sections, keys;
+    std::vector<std::string> flat;
+    for(size_t s = 0; s < cfg.section_count(); ++s)
+    {
+        const auto name = cfg.section_name(s);
+        for(auto entry = cfg.section_begin(s); entry != cfg.section_end(s); ++entry)
+        {
+            const auto key = cfg.key(*entry);
+            sections.push_back(name);
+            keys.push_back(key);
+            flat.push_back(std::string(name.ptr(), name.size()) + "." +
+                           std::string(key.ptr(), key.size()));
+        }
+    }
+    std::vector<std::string> flat_sorted(flat);
+    std::sort(flat_sorted.begin(), flat_sorted.end());
+
+    // Look up in random order so we don't just walk through memory.
+    std::vector<size_t> order(keys.size());
+    for(size_t k = 0; k < order.size(); ++k)
+    {
+        order[k] = k;
+    }
+    std::mt19937 rng(42);
+
+    uint64_t sections_ns = 0, flat_ns = 0;
+    size_t found = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        std::shuffle(order.begin(), order.end(), rng);
+
+        uint64_t start = get_nsecs();
+        for(const size_t k: order)
+        {
+            found += cfg.find(sections[k], keys[k]) != cfg.end();
+        }
+        sections_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        for(const size_t k: order)
+        {
+            found += std::binary_search(flat_sorted.begin(), flat_sorted.end(), flat[k]);
+        }
+        flat_ns += get_nsecs() - start;
+    }
+    if(found != 2 * times * keys.size())
+    {
+        std::cerr << "ERROR: some keys were not found" << std::endl;
+        return 1;
+    }
+
+    const double lookups = static_cast<double>(times) * keys.size();
+    std::cout << keys.size() << " keys in " << cfg.section_count() << " sections (including "
+              << "the unnamed one), parsed in " << parse_ns / 1000 << " us\n"
+              << "Average lookup over " << times << " lookups of each key:\n"
+              << "\tfind(section, key):          " << sections_ns / lookups << " ns\n"
+              << "\tglobal \"section.key\" array: " << flat_ns / lookups << " ns\n";
+    return 0;
+}
@@ -0,0 +1,139 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares cfg5 startup time from text (parsing) with loading a compiled snapshot (see
+// cfgc.cpp and snapshot.h). Startup is measured until the first lookup is done.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Are two CFGs the same (same sections, keys and values in the same order)?
+bool same(const CFG& a, const CFG& b)
+{
+    if(a.section_count() != b.section_count() || a.size() != b.size())
+    {
+        return false;
+    }
+    for(size_t s = 0; s < a.section_count(); ++s)
+    {
+        if(!(a.section_name(s) == b.section_name(s)))
+        {
+            return false;
+        }
+        auto eb = b.section_begin(s);
+        for(auto ea = a.section_begin(s); ea != a.section_end(s); ++ea, ++eb)
+        {
+            if(eb == b.section_end(s) || !(a.key(*ea) == b.key(*eb)) ||
+               !(a.value(*ea) == b.value(*eb)))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-snapshot huge.cfg 20 " << std::endl;
+        std::cerr << "(writes a snapshot to huge.cfg.snap)" << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+    const std::string snapshot = std::string(filename) + ".snap";
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    SourceStamp stamp;
+    const bool stamped = source_stamp(filename, stamp);
+    const CFG parsed(filename, Loader::MMAP);
+    if(!stamped || !parsed.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+        return 1;
+    }
+    uint64_t compile_ns = get_nsecs();
+    if(!parsed.save_snapshot(snapshot, stamp))
+    {
+        std::cerr << "ERROR: Failed to write snapshot " << snapshot << std::endl;
+        return 1;
+    }
+    compile_ns = get_nsecs() - compile_ns;
+
+    // A key to look up: the middle key of the unnamed section, if any.
+    const size_t root = parsed.section_end(0) - parsed.begin();
+    const auto lookup = root == 0 ? Slice<const char>(filename, 0)
+                                  : parsed.key(*(parsed.begin() + root / 2));
+
+    // Found entries, so the compiler can't skip lookups.
+    size_t found = 0;
+    uint64_t text_ns = 0, snapshot_ns = 0, unchecked_ns = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        uint64_t start = get_nsecs();
+        {
+            const CFG cfg(filename, Loader::MMAP);
+            found += cfg.find(lookup) != cfg.end();
+        }
+        text_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        {
+            const CFG cfg = CFG::load_snapshot(snapshot, filename);
+            if(!cfg.is_valid())
+            {
+                std::cerr << "ERROR: Failed to load snapshot " << snapshot << std::endl;
+                return 1;
+            }
+            found += cfg.find(lookup) != cfg.end();
+        }
+        snapshot_ns += get_nsecs() - start;
+
+        start = get_nsecs();
+        {
+            const CFG cfg = CFG::load_snapshot(snapshot, filename, false);
+            found += cfg.find(lookup) != cfg.end();
+        }
+        unchecked_ns += get_nsecs() - start;
+    }
+
+    const CFG loaded = CFG::load_snapshot(snapshot, filename);
+    if(!same(parsed, loaded) || found != (root == 0 ? 0 : 3 * times))
+    {
+        std::cerr << "ERROR: snapshot differs from the parsed file" << std::endl;
+        return 1;
+    }
+
+    std::cout << parsed.size() << " entries, snapshot compiled in " << compile_ns / 1000
+              << " us\n"
+              << "Average startup (load + first find()) over " << times << " runs:\n"
+              << "\ttext (mmap + parse):   " << text_ns / times / 1000.0 << " us\n"
+              << "\tsnapshot:              " << snapshot_ns / times / 1000.0 << " us\n"
+              << "\tsnapshot, no checksum: " << unchecked_ns / times / 1000.0 << " us\n";
+    return 0;
+}
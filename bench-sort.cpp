@@ -0,0 +1,134 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Compares sorting CFG entries with std::sort followed by a duplicate check (what cfg5
+// used to do) with string_sort() (string-sort.h), which finds duplicates while sorting.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// std::sort entries by key and check for duplicates. Returns false if there are any.
+bool std_sort(const Text& text, std::vector<Entry>& entries)
+{
+    std::sort(entries.begin(), entries.end(), [&text](const Entry& a, const Entry& b) {
+        if(a.prefix != b.prefix)
+        {
+            return a.prefix < b.prefix;
+        }
+        return compare(text.slice(a.key), text.slice(b.key)) < 0;
+    });
+    for(size_t e = 1; e < entries.size(); ++e)
+    {
+        if(text.slice(entries[e - 1].key) == text.slice(entries[e].key))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// string_sort() entries by key. Returns false if there are duplicates.
+bool radix_sort(const Text& text, std::vector<Entry>& entries)
+{
+    Entry duplicate;
+    return string_sort(entries.data(), entries.size(),
+                       [&text](const Entry& e) { return text.slice(e.key); },
+                       [](const Entry& e) { return e.prefix; },
+                       duplicate);
+}
+
+/// Sort copies of entries times times with sort, return the average time in ns.
+template<typename Sort>
+uint64_t bench_sort(const Text& text, const std::vector<Entry>& entries,
+                    const unsigned times, const Sort& sort, std::vector<Entry>& sorted,
+                    bool& unique)
+{
+    uint64_t total = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        sorted = entries;
+        const uint64_t start = get_nsecs();
+        unique = sort(text, sorted);
+        total += get_nsecs() - start;
+    }
+    return total / times;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-sort huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    Text text;
+    if(!text.load(filename, Loader::MMAP))
+    {
+        std::cerr << "ERROR: Failed to open file " << filename << std::endl;
+        return 1;
+    }
+
+    // Entries in file order, like the CFG constructor gets them from the scanner.
+    std::vector<Entry> entries;
+    const char* const data = text.data();
+    const auto add_entry = [&entries, data](const Span key, const Span value) {
+        entries.push_back(make_entry(data, key, value));
+    };
+    Span error;
+    if(!scan_lines(text.data(), text.size(), add_entry, error))
+    {
+        std::cerr << "ERROR: Failed to parse file " << filename << std::endl;
+        return 1;
+    }
+
+    std::vector<Entry> std_sorted, radix_sorted;
+    bool std_unique, radix_unique;
+    const uint64_t std_ns   = bench_sort(text, entries, times, std_sort, std_sorted, std_unique);
+    const uint64_t radix_ns = bench_sort(text, entries, times, radix_sort, radix_sorted,
+                                         radix_unique);
+
+    std::cout << "Sorting " << entries.size() << " entries, average of " << times << " runs:\n"
+              << "\tstd::sort + duplicate check: " << std_ns / 1000 << " us\n"
+              << "\tstring_sort:                 " << radix_ns / 1000 << " us\n";
+
+    // Entries with equal keys may be in different order, so compare keys only.
+    bool same = std_unique == radix_unique;
+    for(size_t e = 0; same && e < entries.size(); ++e)
+    {
+        same = text.slice(std_sorted[e].key) == text.slice(radix_sorted[e].key);
+    }
+    if(!same)
+    {
+        std::cerr << "ERROR: sorts gave different results" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Runs frames of simulated work, about 1% of them 50 times slower in one zone, and checks
+// that FrameCapture (see frame-capture.h) captures the slow frames.
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "diy.h"
+#include "frame-capture.h"
+
+
+/// Prevents work from being optimized away.
+volatile uint64_t work_result = 0;
+
+/// Do some work, about units * 1 us.
+void work(const unsigned units)
+{
+    uint64_t x = work_result;
+    for(unsigned i = 0; i < units * 400; ++i)
+    {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    work_result = x;
+}
+
+/// Run frames of zones. Frames in slow are 50 times slower in "update".
+/// Returns average ns per frame.
+double run_frames(const unsigned frames, const std::vector<bool>& slow)
+{
+    static const ZoneId input  = zone_id("input");
+    static const ZoneId update = zone_id("update");
+    static const ZoneId render = zone_id("render");
+    static const ZoneId draw   = zone_id("draw");
+    const uint64_t start = get_nsecs();
+    for(unsigned f = 0; f < frames; ++f)
+    {
+        Frame frame;
+        {
+            Zone zone(input);
+            work(2);
+        }
+        {
+            Zone zone(update);
+            work(slow[f] ? 500 : 10);
+        }
+        {
+            Zone zone(render);
+            for(unsigned d = 0; d < 10; ++d)
+            {
+                Zone zone(draw);
+                work(1);
+            }
+        }
+    }
+    return static_cast<double>(get_nsecs() - start) / frames;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-spikes 10000 " << std::endl;
+        return 1;
+    }
+
+    unsigned frames;
+    try
+    {
+        frames = std::stoul(argv[1]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: first arg must be a number" << std::endl;
+        return 1;
+    }
+    if(frames < FrameCapture::MIN_FRAMES)
+    {
+        std::cerr << "ERROR: first arg must be at least " << +FrameCapture::MIN_FRAMES
+                  << std::endl;
+        return 1;
+    }
+
+    // Slow frames, but none among the first frames (there's no threshold yet).
+    std::vector<bool> slow(frames, false);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<unsigned> percent(0, 99);
+    size_t slow_count = 0;
+    for(unsigned f = FrameCapture::MIN_FRAMES; f < frames; ++f)
+    {
+        slow[f] = percent(rng) == 0;
+        slow_count += slow[f];
+    }
+
+    run_frames(frames / 10 + 1, slow);
+    const double plain_ns = run_frames(frames, slow);
+
+    const size_t keep = 16;
+    FrameCapture capture(128, 95.0, keep);
+    double captured_ns;
+    uint64_t overflows;
+    {
+        ZoneCollector collector(capture.sink());
+        captured_ns = run_frames(frames, slow);
+        collector.stop();
+        overflows = collector.overflows();
+    }
+
+    // Kept frames should be slow ones, or frames slowed down by something else (e.g. the
+    // thread being preempted).
+    size_t slow_kept = 0;
+    const CapturedFrame* example = nullptr;
+    for(const auto& frame: capture.captured())
+    {
+        // The frame and its 13 zones.
+        if(frame.duration_ns <= frame.threshold_ns || frame.zones.size() != 14 ||
+           frame.zones.front().zone != frame_zone_id())
+        {
+            std::cerr << "ERROR: captured frame " << frame.index << " is wrong" << std::endl;
+            return 1;
+        }
+        slow_kept += slow[frame.index];
+        if(example == nullptr || (slow[frame.index] && !slow[example->index]))
+        {
+            example = &frame;
+        }
+    }
+    std::cout << frames << " frames, " << slow_count << " slow:\n"
+              << "\t" << plain_ns / 1e3 << " us per frame, with FrameCapture "
+              << captured_ns / 1e3 << " us (" << overflows << " zones dropped)\n"
+              << "\t" << capture.spikes() << " frames over the 95th percentile, "
+              << capture.captured().size() << " slowest kept, " << slow_kept
+              << " of them slow; window takes " << capture.window_bytes() / 1024 << " kiB\n";
+
+    if(example != nullptr)
+    {
+        std::cout << "frame " << example->index << " (" << example->duration_ns / 1e3
+                  << " us, threshold " << example->threshold_ns / 1e3 << " us):\n";
+        for(const ZoneRecord& zone: example->zones)
+        {
+            std::cout << "\t" << std::string(2 * zone.depth, ' ') << zone_name(zone.zone)
+                      << " " << (ticks_to_nsecs(zone.end) - ticks_to_nsecs(zone.start)) / 1e3
+                      << " us\n";
+        }
+    }
+    return 0;
+}
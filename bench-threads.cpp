@@ -0,0 +1,80 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures how cfg5 parse time scales with the number of parsing threads.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+#include "diy.h"
+
+
+/// Parse filename times times on threads threads, return the average time in ns.
+uint64_t bench_threads(const char* const filename, const unsigned times, const unsigned threads)
+{
+    uint64_t total = 0;
+    for(unsigned t = 0; t < times; ++t)
+    {
+        const uint64_t start = get_nsecs();
+        CFG cfg(filename, Loader::MMAP, threads);
+        total += get_nsecs() - start;
+
+        if(!cfg.is_valid())
+        {
+            std::cerr << "ERROR: Failed to open or parse file " << filename << std::endl;
+            return 0;
+        }
+    }
+    return total / times;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-threads huge.cfg 20 " << std::endl;
+        return 1;
+    }
+
+    const char* const filename = argv[1];
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[2]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: second arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: second arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    // Warm up the page cache.
+    bench_threads(filename, 1, 1);
+
+    std::cout << "Average parse time over " << times << " runs ("
+              << std::thread::hardware_concurrency() << " hardware threads):\n";
+    uint64_t single_ns = 0;
+    for(const unsigned threads: {1u, 2u, 4u, 8u})
+    {
+        const uint64_t ns = bench_threads(filename, times, threads);
+        if(ns == 0)
+        {
+            return 1;
+        }
+        single_ns = threads == 1 ? ns : single_ns;
+        std::cout << "\t" << threads << " threads: " << ns / 1000 << " us, speedup "
+                  << static_cast<double>(single_ns) / ns << "x\n";
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Streams millions of zones of 2 threads to a Chrome trace file (see trace-export.h) and
+// measures the cost of zones with and without the trace being written.
+
+#include <sys/resource.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diy.h"
+#include "trace-export.h"
+
+
+/// Prevents work from being optimized away. One per thread, so threads don't share it.
+thread_local volatile uint64_t work_result = 0;
+
+/// Record zones in groups of 7: an "outer" zone with 3 "inner" zones, each with a "leaf"
+/// zone doing a little work. Returns average ns per zone.
+double run_zones(const unsigned zones)
+{
+    static const ZoneId outer = zone_id("outer");
+    static const ZoneId inner = zone_id("inner");
+    static const ZoneId leaf  = zone_id("leaf \"quoted\"");
+    const uint64_t start = get_nsecs();
+    uint64_t x = work_result;
+    for(unsigned z = 0; z < zones; z += 7)
+    {
+        Zone zone(outer);
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            Zone zone(inner);
+            Zone zone2(leaf);
+            for(unsigned w = 0; w < 400; ++w)
+            {
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+        }
+    }
+    work_result = x;
+    return static_cast<double>(get_nsecs() - start) / zones;
+}
+
+/// Run zones on threads threads at the same time. Returns average ns per zone.
+double run_threads(const unsigned zones, const unsigned threads)
+{
+    std::vector<double> ns(threads);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&ns, t, zones]() { ns[t] = run_zones(zones); }));
+    }
+    double sum = 0.0;
+    for(unsigned t = 0; t < threads; ++t)
+    {
+        workers[t].join();
+        sum += ns[t];
+    }
+    return sum / threads;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-trace 2000000 trace.json " << std::endl;
+        std::cerr << "(zones per thread, output file)" << std::endl;
+        return 1;
+    }
+
+    unsigned zones;
+    try
+    {
+        zones = std::stoul(argv[1]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: first arg must be a number" << std::endl;
+        return 1;
+    }
+    const std::string filename = argv[2];
+    const unsigned threads = 2;
+
+    run_threads(zones / 10 + 1, threads);
+    const double plain_ns = run_threads(zones, threads);
+
+    ChromeTraceWriter writer(filename);
+    double traced_ns;
+    uint64_t collected, overflows;
+    const uint64_t start = get_nsecs();
+    {
+        ZoneCollector collector(writer.sink());
+        traced_ns = run_threads(zones, threads);
+        collector.stop();
+        collected = collector.collected();
+        overflows = collector.overflows();
+    }
+    if(!writer.finish())
+    {
+        std::cerr << "ERROR: Failed to write " << filename << std::endl;
+        return 1;
+    }
+    const uint64_t total_ns = get_nsecs() - start;
+    if(writer.events() != collected)
+    {
+        std::cerr << "ERROR: collected and written events differ" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << threads << " threads, " << zones << " zones each:\n"
+              << "\t" << plain_ns << " ns per zone, " << traced_ns << " ns with a trace\n"
+              << "\t" << writer.events() << " events (" << overflows << " dropped) written "
+              << "to " << filename << " (" << file.tellg() / (1024 * 1024) << " MiB) in "
+              << total_ns / 1e6 << " ms; peak memory " << usage.ru_maxrss / 1024
+              << " MiB\n";
+    return 0;
+}
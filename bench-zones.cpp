@@ -0,0 +1,143 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the overhead of diy.h Zones (a constructor + destructor) with each clock, and
+// with their records collected by a ZoneCollector.
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "diy.h"
+
+
+/// Construct and destroy times empty zones (in pairs, one nested in the other). Returns
+/// average ns per zone.
+double bench_zones(const unsigned times)
+{
+    static const ZoneId outer = zone_id("outer");
+    static const ZoneId inner = zone_id("inner");
+    const uint64_t start = get_nsecs();
+    for(unsigned t = 0; t < times; t += 2)
+    {
+        Zone zone(outer);
+        Zone nested(inner);
+    }
+    return static_cast<double>(get_nsecs() - start) / times;
+}
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./bench-zones 10000000 " << std::endl;
+        return 1;
+    }
+
+    unsigned times;
+    try
+    {
+        times = std::stoul(argv[1]);
+    }
+    catch(...)
+    {
+        std::cerr << "ERROR: first arg must be a number" << std::endl;
+        return 1;
+    }
+    if(times == 0)
+    {
+        std::cerr << "ERROR: first arg must not be zero" << std::endl;
+        return 1;
+    }
+
+    const bool invariant = has_invariant_tsc();
+    std::cout << "invariant TSC: " << (invariant ? "yes" : "no") << ", default clock: "
+              << (default_zone_clock() == ZoneClock::MONOTONIC ? "CLOCK_MONOTONIC" : "rdtsc")
+              << "\n";
+
+    const struct
+    {
+        ZoneClock clock;
+        const char* name;
+    } clocks[] = {{ZoneClock::MONOTONIC, "CLOCK_MONOTONIC"},
+                  {ZoneClock::RDTSC,     "rdtsc          "},
+                  {ZoneClock::RDTSCP,    "rdtscp         "}};
+    for(const auto& c: clocks)
+    {
+        // Measure even a TSC that is not invariant; only the overhead matters here.
+        if(set_zone_clock(c.clock, true) != c.clock)
+        {
+            std::cout << "\t" << c.name << ": not available\n";
+            continue;
+        }
+        // Warm up, then measure.
+        bench_zones(times / 10 + 1);
+        std::cout << "\t" << c.name << ": " << bench_zones(times) << " ns per Zone";
+        if(c.clock != ZoneClock::MONOTONIC)
+        {
+            std::cout << " (" << 1.0 / zone_clock().nsecs_per_tick << " ticks per ns)";
+        }
+        std::cout << "\n";
+    }
+
+    // Zones with records collected, on 1 and 2 threads, with the default clock.
+    set_zone_clock(ZoneClock::RDTSC);
+    std::cout << "with a ZoneCollector (" << ZONE_BUFFER_RECORDS << " records per thread, "
+              << "drained every 1 ms):\n";
+    for(const unsigned threads: {1u, 2u})
+    {
+        // Sinks run on the collector thread only.
+        uint64_t sunk = 0;
+        uint64_t bad = 0;
+        ZoneCollector collector([&](uint32_t, const ZoneRecord* records, size_t count)
+        {
+            for(size_t r = 0; r < count; ++r)
+            {
+                bad += records[r].end < records[r].start || records[r].depth > 1;
+            }
+            sunk += count;
+        });
+        std::vector<double> ns(threads);
+        std::vector<std::thread> workers;
+        for(unsigned t = 0; t < threads; ++t)
+        {
+            workers.push_back(std::thread([&ns, t, times]() { ns[t] = bench_zones(times); }));
+        }
+        for(auto& worker: workers)
+        {
+            worker.join();
+        }
+        collector.stop();
+        if(sunk != collector.collected() || bad != 0 ||
+           collector.collected() + collector.overflows() != uint64_t(times + 1) / 2 * 2 * threads)
+        {
+            std::cerr << "ERROR: records lost or corrupted" << std::endl;
+            return 1;
+        }
+        std::cout << "\t" << threads << " thread(s): ";
+        for(const double n: ns)
+        {
+            std::cout << n << " ns per Zone, ";
+        }
+        std::cout << collector.collected() << " collected, " << collector.overflows()
+                  << " dropped\n";
+    }
+
+    // Check the calibration: time the same interval with both clocks.
+    if(set_zone_clock(ZoneClock::RDTSC, true) == ZoneClock::RDTSC)
+    {
+        const uint64_t ticks_start = zone_ticks();
+        const uint64_t nsecs_start = get_nsecs();
+        while(get_nsecs() - nsecs_start < 100000000) {}
+        const uint64_t ticks_end = zone_ticks();
+        const uint64_t nsecs_end = get_nsecs();
+        const int64_t error = static_cast<int64_t>(ticks_to_nsecs(ticks_end) - nsecs_end) -
+                              static_cast<int64_t>(ticks_to_nsecs(ticks_start) - nsecs_start);
+        std::cout << "rdtsc vs CLOCK_MONOTONIC over 100 ms: " << error << " ns apart\n";
+    }
+    return 0;
+}
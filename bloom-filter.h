@@ -0,0 +1,139 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef BLOOM_FILTER_H_ZRKCQWVH
+#define BLOOM_FILTER_H_ZRKCQWVH
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+
+/** Blocked Bloom filter: tells quickly that a key is *not* in a set.
+ *
+ * A plain Bloom filter sets k bits all over the array for each key, so a lookup takes k
+ * cache misses. Here each key maps to one block of 512 bits (a cache line) and sets one
+ * bit in each of its 8 64-bit words. A lookup is one cache miss and a few bit operations.
+ * Packing bits of a key into a block makes false positives a bit more likely than in a
+ * plain Bloom filter: about 1% with the default 10 bits per key.
+ *
+ * The filter is built from key hashes; a key that may_contain() rejects is certainly not
+ * in the set.
+ */
+class BloomFilter
+{
+private:
+    static const size_t WORDS_PER_BLOCK = 8;
+
+    // Blocks of the filter. Allocated with extra space for alignment; use words() to get
+    // the cache line aligned array.
+    std::vector<uint64_t> storage;
+
+    size_t block_count = 0;
+
+    /// Get the cache line aligned words of the filter.
+    const uint64_t* words() const
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+        return reinterpret_cast<const uint64_t*>((address + 63) & ~uintptr_t(63));
+    }
+
+    uint64_t* words_mutable()
+    {
+        return const_cast<uint64_t*>(words());
+    }
+
+    /// Get the first word of the block of a hash (chosen by its upper 32 bits).
+    size_t block_of(const uint64_t hash) const
+    {
+        return ((hash >> 32) * block_count >> 32) * WORDS_PER_BLOCK;
+    }
+
+    /// Bits of a hash in its block: bit (bits >> 6 * w) & 63 of word w. Independent of
+    /// the bits that chose the block.
+    static uint64_t block_bits(const uint64_t hash)
+    {
+        return hash_mix(hash ^ 0xC2B2AE3D27D4EB4FULL);
+    }
+
+public:
+    /// Default size of the filter. Each extra bit per key roughly halves false positives.
+    static const unsigned DEFAULT_BITS_PER_KEY = 10;
+
+    BloomFilter() {}
+
+    /// A copy of storage may be aligned differently, so words are copied to the aligned
+    /// array of the copy, not just to the same indices of storage.
+    BloomFilter(const BloomFilter& other)
+        : storage(other.storage.size())
+        , block_count(other.block_count)
+    {
+        std::copy(other.words(), other.words() + block_count * WORDS_PER_BLOCK,
+                  words_mutable());
+    }
+
+    // Moving keeps the same storage, so it stays aligned.
+    BloomFilter(BloomFilter&& other) = default;
+    BloomFilter& operator=(BloomFilter&& other) = default;
+
+    BloomFilter& operator=(const BloomFilter& other)
+    {
+        BloomFilter copy(other);
+        return *this = std::move(copy);
+    }
+
+    /** Build the filter.
+     *
+     * count        = Number of keys.
+     * hash_of      = hash_of(i) must return the hash of key i.
+     * bits_per_key = Size of the filter.
+     */
+    template<typename HashOf>
+    void build(const size_t count, const HashOf& hash_of,
+               const unsigned bits_per_key = DEFAULT_BITS_PER_KEY)
+    {
+        const size_t block_bits_total = WORDS_PER_BLOCK * 64;
+        block_count = std::max<size_t>(1, (count * bits_per_key + block_bits_total - 1) /
+                                          block_bits_total);
+        // + 7 for alignment.
+        storage.assign(block_count * WORDS_PER_BLOCK + 7, 0);
+        uint64_t* const w = words_mutable();
+        for(size_t i = 0; i < count; ++i)
+        {
+            const uint64_t hash   = hash_of(i);
+            uint64_t* const block = w + block_of(hash);
+            const uint64_t bits   = block_bits(hash);
+            for(size_t word = 0; word < WORDS_PER_BLOCK; ++word)
+            {
+                block[word] |= uint64_t(1) << ((bits >> (6 * word)) & 63);
+            }
+        }
+    }
+
+    /// Has the filter been built?
+    bool empty() const { return storage.empty(); }
+
+    /// Size of the filter in bytes.
+    size_t bytes() const { return storage.size() * sizeof(uint64_t); }
+
+    /// Can a key with specified hash be in the set? If false, it's certainly not.
+    bool may_contain(const uint64_t hash) const
+    {
+        const uint64_t* const block = words() + block_of(hash);
+        const uint64_t bits = block_bits(hash);
+        // No branches: all words are in one cache line anyway.
+        uint64_t all = 1;
+        for(size_t word = 0; word < WORDS_PER_BLOCK; ++word)
+        {
+            all &= block[word] >> ((bits >> (6 * word)) & 63);
+        }
+        return all != 0;
+    }
+};
+
+#endif /* end of include guard: BLOOM_FILTER_H_ZRKCQWVH */
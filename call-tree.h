@@ -0,0 +1,253 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CALL_TREE_H_WNQDRKBF
+#define CALL_TREE_H_WNQDRKBF
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "diy.h"
+
+/** Call tree of zones, aggregated from ZoneRecords as they are collected.
+ *
+ * Each node is a call path: a zone and the zones it was in (see zone_path()). A record
+ * is added to its node as it arrives (call count, total (inclusive) time, min and max)
+ * and its time is added to the children time of its parent node, so exclusive time is
+ * total minus children time. Records are not stored; memory is fixed by the node limit
+ * passed to the constructor. Records of call paths over the limit are counted by
+ * dropped(). Records dropped by a full ZoneBuffer are missing from the times, so the
+ * exclusive time of their parents is too high.
+ *
+ * Call paths of all threads are merged. Not thread-safe: add records from one thread
+ * (e.g. as the sink of a ZoneCollector) and read the tree once the collector stops.
+ */
+class CallTree
+{
+public:
+    /// A call path node.
+    struct Node
+    {
+        uint64_t path;
+        // Path of the parent node (0 for top-level zones).
+        uint64_t parent_path;
+        ZoneId zone;
+        uint32_t depth;
+        // Number of calls (finished zones). 0 if the node was only added as a parent of
+        // another node; the parent hasn't finished yet and its zone is unknown.
+        uint64_t count;
+        // Inclusive time of all calls, and of zones called in them.
+        uint64_t total_ns;
+        uint64_t children_ns;
+        // Shortest and longest call.
+        uint64_t min_ns;
+        uint64_t max_ns;
+
+        /// Time spent in the zone itself, not in zones in it.
+        uint64_t exclusive_ns() const
+        {
+            return total_ns > children_ns ? total_ns - children_ns : 0;
+        }
+    };
+
+private:
+    // Reserved to max_nodes, so pointers to nodes are stable.
+    std::vector<Node> nodes_;
+
+    const size_t max_nodes;
+
+    // Open addressing table of node indices + 1 (0 is an empty slot) by path. At least
+    // twice as big as max_nodes, so it never gets full.
+    std::vector<uint32_t> table;
+
+    uint64_t dropped_;
+
+    /// Find the table slot of a path: its node or the empty slot to add it to.
+    size_t slot(const uint64_t path) const
+    {
+        // Paths are already hashes.
+        size_t s = static_cast<size_t>(path) & (table.size() - 1);
+        while(table[s] != 0 && nodes_[table[s] - 1].path != path)
+        {
+            s = (s + 1) & (table.size() - 1);
+        }
+        return s;
+    }
+
+    /// Get the node of a path, adding it if it's not there. nullptr if the tree is full.
+    Node* node(const uint64_t path)
+    {
+        const size_t s = slot(path);
+        if(table[s] != 0)
+        {
+            return &nodes_[table[s] - 1];
+        }
+        if(nodes_.size() == max_nodes)
+        {
+            return nullptr;
+        }
+        nodes_.push_back(Node{path, 0, 0, 0, 0, 0, 0, UINT64_MAX, 0});
+        table[s] = static_cast<uint32_t>(nodes_.size());
+        return &nodes_.back();
+    }
+
+    /// Print a node and its subtree. children[i] are indices of child nodes of node i.
+    void report_node(std::ostream& out, const std::vector<std::vector<size_t>>& children,
+                     const size_t index, const unsigned indent) const
+    {
+        const Node& n = nodes_[index];
+        out << std::setw(10) << n.count << std::setw(12) << n.total_ns / 1e6
+            << std::setw(12) << n.exclusive_ns() / 1e6
+            << std::setw(12) << (n.count == 0 ? 0.0 : n.min_ns / 1e3)
+            << std::setw(12) << n.max_ns / 1e3 << "   " << std::string(2 * indent, ' ')
+            << (n.count == 0 ? "(unfinished)" : zone_name(n.zone)) << "\n";
+        for(const size_t child: children[index])
+        {
+            report_node(out, children, child, indent + 1);
+        }
+    }
+
+public:
+    /// Construct a tree of at most max_nodes call paths.
+    explicit CallTree(const size_t max_nodes = 4096)
+        : max_nodes(max_nodes)
+        , dropped_(0)
+    {
+        nodes_.reserve(max_nodes);
+        size_t slots = 2;
+        while(slots < 2 * max_nodes)
+        {
+            slots *= 2;
+        }
+        table.resize(slots, 0);
+    }
+
+    /// Add records of finished zones.
+    void add(const ZoneRecord* const records, const size_t count)
+    {
+        for(size_t r = 0; r < count; ++r)
+        {
+            const ZoneRecord& record = records[r];
+            const uint64_t ns = ticks_to_nsecs(record.end) - ticks_to_nsecs(record.start);
+            Node* const n = node(zone_path(record.parent_path, record.zone));
+            if(n == nullptr)
+            {
+                ++dropped_;
+                continue;
+            }
+            n->parent_path = record.parent_path;
+            n->zone        = record.zone;
+            n->depth       = record.depth;
+            ++n->count;
+            n->total_ns += ns;
+            n->min_ns    = std::min(n->min_ns, ns);
+            n->max_ns    = std::max(n->max_ns, ns);
+            if(record.parent_path == 0)
+            {
+                continue;
+            }
+            Node* const parent = node(record.parent_path);
+            if(parent != nullptr)
+            {
+                parent->children_ns += ns;
+            }
+        }
+    }
+
+    /// A ZoneCollector sink adding records to the tree. The tree must outlive the collector.
+    ZoneCollector::Sink sink()
+    {
+        return [this](uint32_t, const ZoneRecord* records, size_t count)
+        {
+            add(records, count);
+        };
+    }
+
+    /// Call path nodes, in the order they were added.
+    const std::vector<Node>& nodes() const { return nodes_; }
+
+    /// Number of records not added because the tree was full.
+    uint64_t dropped() const { return dropped_; }
+
+    /** Print the tree: a line per node, children under their parents, ordered by total
+     * time. Times in ms except min/max in us.
+     */
+    void report(std::ostream& out) const
+    {
+        std::vector<std::vector<size_t>> children(nodes_.size());
+        std::vector<size_t> roots;
+        for(size_t i = 0; i < nodes_.size(); ++i)
+        {
+            const uint64_t parent = nodes_[i].parent_path;
+            const size_t s = parent == 0 ? 0 : slot(parent);
+            // Nodes not finished yet don't know their parent; print them as roots.
+            (parent == 0 || table[s] == 0 ? roots : children[table[s] - 1]).push_back(i);
+        }
+        const auto by_total = [this](const size_t a, const size_t b)
+        {
+            return nodes_[a].total_ns > nodes_[b].total_ns;
+        };
+        std::sort(roots.begin(), roots.end(), by_total);
+        for(auto& c: children)
+        {
+            std::sort(c.begin(), c.end(), by_total);
+        }
+
+        const auto flags     = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(3)
+            << "     calls    total ms     excl ms      min us      max us   zone\n";
+        for(const size_t root: roots)
+        {
+            report_node(out, children, root, 0);
+        }
+        if(dropped_ != 0)
+        {
+            out << dropped_ << " records of more than " << max_nodes
+                << " call paths not shown\n";
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+/** Records zones while it exists and prints their call tree when destroyed.
+ *
+ * E.g. at the beginning of main(). Only one may exist at a time (it has a ZoneCollector).
+ */
+class CallTreeReport
+{
+private:
+    std::ostream& out;
+
+    CallTree tree;
+
+    ZoneCollector collector;
+
+public:
+    explicit CallTreeReport(std::ostream& out = std::cout, const size_t max_nodes = 4096)
+        : out(out)
+        , tree(max_nodes)
+        , collector(tree.sink())
+    {
+    }
+
+    ~CallTreeReport()
+    {
+        collector.stop();
+        tree.report(out);
+        if(collector.overflows() != 0)
+        {
+            out << collector.overflows() << " records dropped by full zone buffers\n";
+        }
+    }
+};
+
+#endif /* end of include guard: CALL_TREE_H_WNQDRKBF */
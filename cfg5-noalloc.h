@@ -10,27 +10,36 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
+#include "bloom-filter.h"
+#include "eytzinger.h"
+#include "hash.h"
+#include "hash-index.h"
+#include "line-chunks.h"
+#include "mapped-file.h"
+#include "parallel.h"
+#include "parse-value.h"
+#include "perfect-hash.h"
+#include "scan.h"
+#include "snapshot.h"
+#include "string-sort.h"
+#include "typed-cache.h"
 
-const std::string SPACES     = " \t";
-const std::string COMMENTS   = ";#";
-const std::string SEPARATORS = "=";
-
-// Elements 9 and 32 (\t and ' ') are true; the rest are false (even after the first 32)
-bool SPACES_LOOKUP[256] =
-    {0, 0, 0, 0, 0, 0, 0, 0,
-     0, 1, 0, 0, 0, 0, 0, 0,
-     0, 0, 0, 0, 0, 0, 0, 0,
-     0, 0, 0, 0, 0, 0, 0, 0,
-     1};
 
 /** This version avoids most allocations by loading the entire file to a single buffer
- * and making all strings point into that buffer.
+ * and making all strings refer to that buffer.
+ *
+ * The buffer is never modified: keys and values are (offset, length) spans into it,
+ * so it can be a read-only mapping of the file and can be shared between copies.
  */
 
 
@@ -60,6 +69,9 @@ public:
         size_ = rhs.size_;
     }
 
+    /// Copy assignment. Implicit one is deprecated since copy constructors are declared.
+    Slice& operator=(const Slice&) = default;
+
     /// Construct a slice of all data in a std::string or std::vector.
     template<typename A>
     Slice(A& array)
@@ -128,178 +140,1077 @@ public:
     /// Get a non-const pointer to the first element of the slice.
     T* ptr_mutable() const { return ptr_; }
 
+    /// Get the pointer to the first element of the slice (for range-based for).
+    const T* begin() const { return ptr_; }
+
     /// Get the pointer *after* the last element of the slice (for STL <algorithm>).
     const T* end() const { return ptr_ + size_; }
 
     /// Get the number of elements in the slice.
     const size_t size() const { return size_; }
-};
 
-/// Trim without any allocation or string construction.
-Slice<char> trim(Slice<char> slice)
-{
-    while(!slice.empty() && SPACES_LOOKUP[slice.front()])
+    /// Get element at specified index.
+    const T& operator[](const size_t index) const
     {
-        slice.pop_front();
+        assert(index < size_);
+        return ptr_[index];
     }
-    while(!slice.empty() && SPACES_LOOKUP[slice.back()])
+};
+
+/// Compare two strings like strcmp(), but using their lengths instead of '\0'.
+int compare(const Slice<const char> a, const Slice<const char> b)
+{
+    const int result = memcmp(a.ptr(), b.ptr(), std::min(a.size(), b.size()));
+    if(result != 0)
     {
-        slice.pop_back();
+        return result;
     }
-    return slice;
+    return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
 }
 
-/// Simple CFG file with no sections, implemented on top of std::map.
-class CFG
+/// Are two strings equal?
+bool operator==(const Slice<const char> a, const Slice<const char> b)
 {
-private:
-    // Vector of key-value pairs sorted by keys.
-    //
-    // Both key and value strings point to the storage vector instead of owning their data.
-    std::vector<std::pair<const char*, const char*>> entries;
+    return a.size() == b.size() && 0 == memcmp(a.ptr(), b.ptr(), a.size());
+}
 
-    // The entire file is loaded here.
+/** A key-value pair; both key and value are spans of CFG text.
+ *
+ * Also contains the first 8 bytes of the key as a big-endian integer (see key_prefix()),
+ * so most key comparisons when sorting and searching are a single integer comparison
+ * that doesn't need to touch the text.
+ */
+struct Entry
+{
+    uint64_t prefix;
+    Span key;
+    Span value;
+};
+
+/// Make an entry from key and value spans of text.
+Entry make_entry(const char* const text, const Span key, const Span value)
+{
+    Entry entry;
+    entry.prefix = key_prefix(text + key.offset, key.length);
+    entry.key    = key;
+    entry.value  = value;
+    return entry;
+}
+
+/// Ways to get the file into memory for parsing.
+enum class Loader
+{
+    /// Copy the file into a std::vector with std::ifstream::read().
+    IFSTREAM,
+    /// mmap() the file read-only and parse it in place, without copying it.
+    ///
+    /// Falls back to IFSTREAM if the file can't be mapped.
+    MMAP
+};
+
+/** Immutable text of a loaded file.
+ *
+ * Owns either a copy of the file in a std::vector, or a read-only mapping of the file.
+ * Never modified after loading, so CFG copies can share it.
+ */
+class Text
+{
+private:
+    // The entire file is loaded here (Loader::IFSTREAM).
     std::vector<char> storage;
 
-    bool valid = true;
+    // The entire file is mapped here (Loader::MMAP).
+    MappedFile mapping;
 
-public:
-    CFG():valid(false) {}
+    // Points either to storage or to mapping.
+    const char* data_ = nullptr;
 
-    CFG(const std::string& filename) noexcept
+    size_t size_ = 0;
+
+    /// Load the file to storage. Returns false if the file could not be read.
+    bool load_ifstream(const std::string& filename)
     {
-        std::ifstream file(filename);
+        std::ifstream file(filename, std::ios::binary);
         if(!file.good())
         {
-            valid = false;
-            return;
+            return false;
         }
 
         // Seek to end of file
         file.seekg(0, std::ios::end);
-        // Resize to file size (+ 1 char for zero terminator)
-        storage.resize(static_cast<size_t>(file.tellg()) + 1);
+        // Resize to file size
+        storage.resize(static_cast<size_t>(file.tellg()));
         // Return to beginning of file
         file.seekg(0, std::ios::beg);
         // Read the entire file
         file.read(storage.data(), storage.size());
-        // Set the last element of storage to '\0', making storage a zero-terminated string
-        storage.back() = '\0';
         file.close();
 
-        const char* const newlines = "\r\n";
+        data_ = storage.data();
+        size_ = storage.size();
+        return true;
+    }
 
-        // Tokenize storage using newlines as delimiters.
-        // strtok() will replace the delimiters in storage with '\0', so the returned
-        // tokens (tok) will be C strings pointing to storage ending before the (replaced)
-        // delimiters.
-        for(char* tok = strtok(storage.data(), newlines);
-            NULL != tok;
-            tok = strtok(NULL, newlines))
+    /// Map the file to mapping. Returns false if the file could not be mapped.
+    bool load_mmap(const std::string& filename)
+    {
+        if(!mapping.open(filename))
         {
-            // Strip comments
-            auto slice = Slice<char>(tok, strlen(tok));
-            // auto slice = Slice<char>(line);
-            const char* comment_ptr = std::find_first_of(slice.ptr(), slice.end(),
-                                                         COMMENTS.begin(), COMMENTS.end());
-            if(comment_ptr != slice.end())
+            return false;
+        }
+
+        data_ = mapping.data();
+        size_ = mapping.size();
+        return true;
+    }
+
+public:
+    Text() {}
+
+    Text(const Text&) = delete;
+    Text& operator=(const Text&) = delete;
+
+    /// Load a file. Returns false if the file could not be read.
+    bool load(const std::string& filename, const Loader loader)
+    {
+        return (loader == Loader::MMAP && load_mmap(filename)) || load_ifstream(filename);
+    }
+
+    /** Use only size bytes at offset of the loaded file as the text.
+     *
+     * Used for snapshots, where the text (string heap) is only a part of the file. The
+     * rest of the file stays loaded.
+     */
+    void narrow(const size_t offset, const size_t size)
+    {
+        assert(offset + size <= size_);
+        data_ += offset;
+        size_  = size;
+    }
+
+    /// Use a string built in memory as the text, instead of loading a file.
+    void assign(std::vector<char>&& string)
+    {
+        storage = std::move(string);
+        data_   = storage.data();
+        size_   = storage.size();
+    }
+
+    /// Done reading the text front to back (if mapped); see MappedFile::end_sequential().
+    void end_sequential() const { mapping.end_sequential(); }
+
+    /// Pointer to the first character of the text.
+    const char* data() const { return data_; }
+
+    /// Size of the text in bytes.
+    size_t size() const { return size_; }
+
+    /// Get the string referred to by a span.
+    Slice<const char> slice(const Span span) const
+    {
+        assert(span.offset + static_cast<size_t>(span.length) <= size_);
+        return Slice<const char>(data_ + span.offset, span.length);
+    }
+
+    /// Get the span referring to a slice of the text.
+    Span span(const Slice<const char> slice) const
+    {
+        assert(slice.ptr() >= data_ && slice.end() <= data_ + size_);
+        Span result;
+        result.offset = static_cast<uint32_t>(slice.ptr() - data_);
+        result.length = static_cast<uint32_t>(slice.size());
+        return result;
+    }
+};
+
+/** CFG file with optional [section] headers.
+ *
+ * Entries are sorted by section and then by key. Entries before the first header are in
+ * an unnamed section; find(key) looks there and find(section, key) in named sections.
+ * A section may have several headers; all their entries are in one section.
+ */
+class CFG
+{
+private:
+    /// A section: name and range of its entries.
+    struct Section
+    {
+        // key_prefix() of the name.
+        uint64_t prefix;
+        Span name;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    /// Entries and sections of a parsed file.
+    struct Parsed
+    {
+        std::vector<Entry> entries;
+        std::vector<Section> sections;
+    };
+
+    // Key-value pairs sorted by sections, then by keys.
+    //
+    // Keys and values are spans of text; entries contain no pointers, so they can be
+    // shared by copies of this CFG and written to a snapshot file as they are. Points
+    // into parsed, or into text for a CFG loaded from a snapshot (see load_snapshot()).
+    Slice<const Entry> entries = Slice<const Entry>(nullptr, 0);
+
+public:
+    typedef const Entry* const_iterator;
+
+    /// Index of an entry, for reading it in O(1) with at(); see resolve().
+    ///
+    /// Only valid for this CFG and its copies; KeyTable (key-table.h) re-resolves IDs of
+    /// keys for a reloaded CFG.
+    typedef uint32_t KeyId;
+
+    /// ID of a key that is not in the CFG.
+    static const KeyId NO_KEY = UINT32_MAX;
+
+private:
+    // Sections sorted by name. Section 0 is the unnamed section (its name is empty).
+    //
+    // This is the first level of the index: find(section, key) binary searches this
+    // small table, then only the entries of one section. Points into parsed or text,
+    // like entries.
+    Slice<const Section> sections = Slice<const Section>(nullptr, 0);
+
+    // Storage of entries and sections if parsed from text. Shared by all copies of this
+    // CFG. Null if loaded from a snapshot.
+    std::shared_ptr<const Parsed> parsed;
+
+    /** Entries of a chunk of text in file order, with section headers.
+     *
+     * Spans are relative to the whole text, not the chunk.
+     */
+    struct ScannedChunk
+    {
+        std::vector<Entry> entries;
+        // Names of section headers in the chunk, in file order.
+        std::vector<Span> headers;
+        // Header number of each entry: 0 for entries before the first header in the
+        // chunk, h + 1 for entries after header h. Empty if there are no headers.
+        std::vector<uint32_t> entry_headers;
+        // The bad line if scanning failed.
+        Span error;
+    };
+
+    // The entire file. Shared by all copies of this CFG.
+    std::shared_ptr<const Text> text;
+
+    // Optional hash index of entries; see build_hash_index().
+    HashIndex hash_index;
+
+    // Optional Eytzinger search index; see build_eytzinger_index().
+    EytzingerIndex eytzinger_index;
+
+    // Optional minimal perfect hash of keys; see freeze().
+    PerfectHash perfect_hash;
+
+    // Optional filter rejecting most keys that are not in the unnamed section; see
+    // build_bloom_filter().
+    BloomFilter bloom_filter;
+
+    // Elements of arrays and multi-value tags, each array contiguous; see build_arrays().
+    // Slices point into text, which is shared by all copies.
+    std::vector<Slice<const char>> array_elements;
+
+    // Range of array_elements of each entry (empty if the entry is not an array), or
+    // empty if build_arrays() was not called.
+    std::vector<Span> entry_arrays;
+
+    // Values converted by get(), by entry index. Shared by all copies of this CFG (they
+    // have the same entries).
+    std::shared_ptr<TypedCache> typed_cache;
+
+    bool valid = true;
+
+    /// find_batch() looks up this many keys at a time. Enough to keep the CPU busy with
+    /// independent cache misses; more would just evict prefetched lines.
+    static const size_t BATCH_GROUP = 16;
+
+    /// Chunks smaller than this are not worth a thread of their own.
+    static const size_t PARALLEL_MIN_CHUNK = 256 * 1024;
+
+    /// Three-way comparison of entries by key.
+    struct KeyCompare
+    {
+        const Text& text;
+
+        int operator()(const Entry& a, const Entry& b) const
+        {
+            if(a.prefix != b.prefix)
             {
-                slice = slice.subslice(0, comment_ptr - slice.ptr());
+                return a.prefix < b.prefix ? -1 : 1;
             }
+            return compare(text.slice(a.key), text.slice(b.key));
+        }
+    };
+
+    /// Print an error about a non-empty line with no separator.
+    void report_line_error(const std::string& filename, const Span line_span) const
+    {
+        const auto line = text->slice(line_span);
+        std::cerr << "ERROR: non-empty line with no separator in "
+                  << filename << ": " << std::string(line.ptr(), line.size())
+                  << std::endl;
+    }
+
+    /// Print an error about a duplicate key in a section.
+    void report_duplicate(const std::string& filename, const Section& section,
+                          const Entry& entry) const
+    {
+        const auto dup_key = key(entry);
+        std::cerr << "ERROR: Duplicate key in " << filename << ": "
+                  << std::string(dup_key.ptr(), dup_key.size());
+        if(section.name.length > 0)
+        {
+            const auto name = text->slice(section.name);
+            std::cerr << " (section [" << std::string(name.ptr(), name.size()) << "])";
+        }
+        std::cerr << std::endl;
+    }
+
+    /** Sort entries by keys with string_sort() and find duplicate keys.
+     *
+     * Returns true if there are no duplicate keys. Otherwise returns false and writes the
+     * entry with the smallest duplicate key to duplicate.
+     */
+    bool sort_entries(Entry* const to_sort, const size_t count, Entry& duplicate) const
+    {
+        const Text& t = *text;
+        return string_sort(to_sort, count,
+                           [&t](const Entry& e) { return t.slice(e.key); },
+                           [](const Entry& e) { return e.prefix; },
+                           duplicate);
+    }
 
-            // Ignore blank and empty lines
-            slice = trim(slice);
-            if(slice.empty())
+    /// Scan text in [begin, end) into chunk. Returns false on error.
+    bool scan_chunk(const size_t begin, const size_t end, ScannedChunk& chunk) const
+    {
+        const char* const data = text->data();
+        // Spans from scan_lines() are relative to the chunk.
+        const uint32_t base = static_cast<uint32_t>(begin);
+        const auto add_entry = [&chunk, data, base](Span key, Span value) {
+            key.offset   += base;
+            value.offset += base;
+            chunk.entries.push_back(make_entry(data, key, value));
+            if(!chunk.headers.empty())
             {
-                continue;
+                chunk.entry_headers.push_back(static_cast<uint32_t>(chunk.headers.size()));
             }
+        };
+        const auto add_section = [&chunk, base](Span name) {
+            name.offset += base;
+            if(chunk.headers.empty())
+            {
+                chunk.entry_headers.assign(chunk.entries.size(), 0);
+            }
+            chunk.headers.push_back(name);
+            return true;
+        };
+        if(!scan_lines(data + begin, end - begin, add_entry, add_section, chunk.error))
+        {
+            chunk.error.offset += base;
+            return false;
+        }
+        return true;
+    }
 
-            // Separate into key and value
-            const char* separator_ptr = std::find_first_of(slice.ptr(), slice.end(),
-                                                           SEPARATORS.begin(), SEPARATORS.end());
-            if(separator_ptr == slice.end())
+    /** Build the section table, group entries by sections and sort each section.
+     *
+     * Entries are in file order when called.
+     *
+     * headers       = Names of all section headers in file order.
+     * entry_headers = Header number of each entry (h + 1 for entries after header h, 0
+     *                 for entries before the first header). May be empty if all entries
+     *                 are in the unnamed section.
+     * threads       = Number of threads to sort sections on.
+     *
+     * Returns false (and reports the error) if a section has duplicate keys.
+     */
+    bool sort_sections(const std::string& filename, const std::vector<Span>& headers,
+                       const std::vector<uint32_t>& entry_headers, const unsigned threads,
+                       Parsed& out) const
+    {
+        // Sort header numbers by names; headers with equal names are one section.
+        const size_t header_count = headers.size() + 1;
+        std::vector<Span> names(1, Span{0, 0});
+        names.insert(names.end(), headers.begin(), headers.end());
+        std::vector<uint64_t> prefixes(header_count);
+        std::vector<uint32_t> order(header_count);
+        for(size_t h = 0; h < header_count; ++h)
+        {
+            const auto name = text->slice(names[h]);
+            prefixes[h] = key_prefix(name.ptr(), name.size());
+            order[h]    = static_cast<uint32_t>(h);
+        }
+        std::sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) {
+            if(prefixes[a] != prefixes[b])
             {
-                // Treat non-empty lines with separators as errors
-                std::cerr << "ERROR: non-empty line with no separator in "
-                          << filename << ": " << std::string(slice.ptr(), slice.size())
-                          << std::endl;
-                valid = false;
-                return;
+                return prefixes[a] < prefixes[b];
             }
+            return compare(text->slice(names[a]), text->slice(names[b])) < 0;
+        });
+        out.sections.clear();
+        std::vector<uint32_t> section_of(header_count);
+        for(const uint32_t h: order)
+        {
+            if(out.sections.empty() ||
+               !(text->slice(out.sections.back().name) == text->slice(names[h])))
+            {
+                out.sections.push_back(Section{prefixes[h], names[h], 0, 0});
+            }
+            section_of[h] = static_cast<uint32_t>(out.sections.size() - 1);
+        }
+        // The unnamed section has the smallest (empty) name.
+        assert(out.sections[0].name.length == 0);
 
-            const size_t separator_idx = separator_ptr - slice.ptr();
-            const auto key_slice = trim(slice.subslice(0, separator_idx));
-            const auto val_slice = trim(slice.subslice(separator_idx + 1));
+        // Group entries by sections (counting sort, stable).
+        if(out.sections.size() == 1)
+        {
+            out.sections[0].end = static_cast<uint32_t>(out.entries.size());
+        }
+        else
+        {
+            for(const uint32_t h: entry_headers)
+            {
+                ++out.sections[section_of[h]].end;
+            }
+            uint32_t begin = 0;
+            for(auto& section: out.sections)
+            {
+                section.begin = begin;
+                begin += section.end;
+                section.end = begin;
+            }
+            std::vector<uint32_t> fill(out.sections.size());
+            for(size_t s = 0; s < out.sections.size(); ++s)
+            {
+                fill[s] = out.sections[s].begin;
+            }
+            std::vector<Entry> grouped(out.entries.size());
+            for(size_t e = 0; e < out.entries.size(); ++e)
+            {
+                grouped[fill[section_of[entry_headers[e]]]++] = out.entries[e];
+            }
+            out.entries.swap(grouped);
+        }
 
-            // No allocations or copying; use pointers to the loaded file.
-            char* key   = key_slice.ptr_mutable();
-            char* value = val_slice.ptr_mutable();
-            // This is safe because the key is followed (at least) by a separator
-            // and the value is followed (at least) by the end of line.
-            key[key_slice.size()]   = '\0';
-            value[val_slice.size()] = '\0';
+        // Sort sections, each thread taking every threads-th section.
+        std::vector<char> failed(out.sections.size(), false);
+        std::vector<Entry> duplicates(out.sections.size());
+        const unsigned workers =
+            static_cast<unsigned>(std::min<size_t>(threads, out.sections.size()));
+        run_parallel(workers, [&](const unsigned w) {
+            for(size_t s = w; s < out.sections.size(); s += workers)
+            {
+                const Section& section = out.sections[s];
+                failed[s] = !sort_entries(out.entries.data() + section.begin,
+                                          section.end - section.begin, duplicates[s]);
+            }
+        });
+        for(size_t s = 0; s < out.sections.size(); ++s)
+        {
+            if(failed[s])
+            {
+                // Treat duplicate keys as errors
+                report_duplicate(filename, out.sections[s], duplicates[s]);
+                return false;
+            }
+        }
+        return true;
+    }
 
-            entries.push_back(std::pair<const char*, const char*>(key, value));
+    /// Parse text into out on one thread. Returns false on error.
+    bool parse(const std::string& filename, Parsed& out) const
+    {
+        // Scan lines into entries; see scan.h.
+        ScannedChunk chunk;
+        if(!scan_chunk(0, text->size(), chunk))
+        {
+            // Treat non-empty lines with separators as errors
+            report_line_error(filename, chunk.error);
+            return false;
         }
+        out.entries.swap(chunk.entries);
+
+        // Sort entries by sections and keys, treating duplicate keys as errors.
+        return sort_sections(filename, chunk.headers, chunk.entry_headers, 1, out);
+    }
 
-        // Sort entries by keys
-        std::sort(entries.begin(), entries.end(),
-                  [](const std::pair<const char*, const char*>& a,
-                     const std::pair<const char*, const char*>& b) {
-            return strcmp(a.first, b.first) < 0;
+    /** Parse text into entries on multiple threads. Returns false on error.
+     *
+     * Each thread scans a chunk of text. Without sections, each thread then sorts its
+     * chunk and the sorted chunks are merged (also in parallel) into out; see
+     * parallel.h. With sections, chunks are concatenated and sections are sorted on
+     * multiple threads. Results and errors are the same as with parse().
+     */
+    bool parse_parallel(const std::string& filename, const unsigned threads,
+                        Parsed& out) const
+    {
+        const char* const data = text->data();
+        const auto bounds = split_lines(data, text->size(), threads, PARALLEL_MIN_CHUNK);
+        const unsigned chunks = static_cast<unsigned>(bounds.size() - 1);
+
+        std::vector<ScannedChunk> scanned(chunks);
+        std::vector<char> failed(chunks, false);
+        run_parallel(chunks, [&](const unsigned c) {
+            failed[c] = !scan_chunk(bounds[c], bounds[c + 1], scanned[c]);
         });
 
-        // Check for duplicates after sorting.
-        bool first_key = true;
-        const char* prev_key;
-        for(auto& key_value: *this)
+        // Report the first bad line in the file, like parse() would.
+        bool has_headers = false;
+        for(unsigned c = 0; c < chunks; ++c)
         {
-            if(!first_key && 0 == strcmp(prev_key, key_value.first))
+            if(failed[c])
             {
-                // Treat duplicate keys as errors
-                std::cerr << "ERROR: Duplicate key in " << filename << ": " << prev_key
-                          << std::endl;
-                valid = false;
-                return;
+                report_line_error(filename, scanned[c].error);
+                return false;
             }
-            else
+            has_headers = has_headers || !scanned[c].headers.empty();
+        }
+
+        if(has_headers)
+        {
+            // Concatenate chunks, numbering headers across the whole text.
+            std::vector<Span> headers;
+            std::vector<uint32_t> entry_headers;
+            // Number of the last header before the current chunk.
+            uint32_t current = 0;
+            for(const auto& chunk: scanned)
+            {
+                const uint32_t first = static_cast<uint32_t>(headers.size());
+                for(size_t e = 0; e < chunk.entries.size(); ++e)
+                {
+                    const uint32_t local = chunk.entry_headers.empty() ? 0
+                                                                       : chunk.entry_headers[e];
+                    entry_headers.push_back(local == 0 ? current : first + local);
+                }
+                out.entries.insert(out.entries.end(), chunk.entries.begin(),
+                                   chunk.entries.end());
+                headers.insert(headers.end(), chunk.headers.begin(), chunk.headers.end());
+                current = chunk.headers.empty() ? current
+                                                : static_cast<uint32_t>(headers.size());
+            }
+            return sort_sections(filename, headers, entry_headers, threads, out);
+        }
+
+        std::vector<std::vector<Entry>> runs(chunks);
+        run_parallel(chunks, [&](const unsigned c) {
+            runs[c].swap(scanned[c].entries);
+            // Duplicates are found when merging, so we don't need them here.
+            Entry duplicate;
+            sort_entries(runs[c].data(), runs[c].size(), duplicate);
+        });
+
+        const size_t duplicate = parallel_merge(runs, out.entries, threads, KeyCompare{*text});
+        out.sections.assign(1, Section{0, Span{0, 0}, 0,
+                                       static_cast<uint32_t>(out.entries.size())});
+        if(duplicate != out.entries.size())
+        {
+            report_duplicate(filename, out.sections[0], out.entries[duplicate]);
+            return false;
+        }
+        return true;
+    }
+
+    /** If entry head is the size of an array (name = N, followed by name1 to nameN), add
+     * the values of the array to array_elements.
+     *
+     * end = End of the section of head.
+     *
+     * Returns false if head is not an array.
+     */
+    bool add_array(const size_t head, const size_t end)
+    {
+        const auto size_value = value(entries[head]);
+        int64_t size;
+        if(!parse_int(size_value.ptr(), size_value.size(), size) || size <= 0 ||
+           static_cast<uint64_t>(size) >= end - head)
+        {
+            return false;
+        }
+
+        // Keys starting with name are sorted right after name; elements are among them.
+        const auto name = key(entries[head]);
+        std::vector<uint32_t> elements(size, UINT32_MAX);
+        for(size_t e = head + 1; e < end; ++e)
+        {
+            const auto k = key(entries[e]);
+            if(k.size() <= name.size() || memcmp(k.ptr(), name.ptr(), name.size()) != 0)
+            {
+                break;
+            }
+            const auto suffix = k.subslice(name.size());
+            int64_t index;
+            if(suffix.front() >= '1' && suffix.front() <= '9' &&
+               parse_int(suffix.ptr(), suffix.size(), index) && index <= size)
+            {
+                elements[index - 1] = static_cast<uint32_t>(e);
+            }
+        }
+        if(std::find(elements.begin(), elements.end(), UINT32_MAX) != elements.end())
+        {
+            return false;
+        }
+
+        entry_arrays[head] = Span{static_cast<uint32_t>(array_elements.size()),
+                                  static_cast<uint32_t>(size)};
+        for(const uint32_t e: elements)
+        {
+            array_elements.push_back(value(entries[e]));
+        }
+        return true;
+    }
+
+    /// If entry e has a multi-value (comma-separated) value, add its values to
+    /// array_elements.
+    void add_multi_value(const size_t e)
+    {
+        const auto v = value(entries[e]);
+        if(memchr(v.ptr(), ',', v.size()) == nullptr)
+        {
+            return;
+        }
+        entry_arrays[e].offset = static_cast<uint32_t>(array_elements.size());
+        const char* start = v.ptr();
+        for(;;)
+        {
+            const char* const comma =
+                static_cast<const char*>(memchr(start, ',', v.end() - start));
+            const char* const stop = comma == nullptr ? v.end() : comma;
+            // Trim spaces around the value.
+            const char* first = start;
+            const char* last  = stop;
+            while(first < last && (*first == ' ' || *first == '\t'))
+            {
+                ++first;
+            }
+            while(last > first && (last[-1] == ' ' || last[-1] == '\t'))
+            {
+                --last;
+            }
+            array_elements.push_back(Slice<const char>(first, last - first));
+            if(comma == nullptr)
             {
-                first_key = false;
+                break;
             }
-            prev_key = key_value.first;
+            start = comma + 1;
         }
+        entry_arrays[e].length =
+            static_cast<uint32_t>(array_elements.size() - entry_arrays[e].offset);
     }
 
-    // storage destructor is called automatically.
-    ~CFG()
+    /// Number of entries in the unnamed section; they are at the start of entries.
+    size_t root_size() const
     {
+        return sections.empty() ? 0 : sections[0].end;
     }
 
-    // Need to copy our strings in the copy constructor; otherwise any copy of CFG would
-    // delete our keys/values when destroyed.
-    CFG(const CFG& other)
+    /// Find the section with specified name. Returns sections.size() if not found.
+    size_t find_section(const Slice<const char> name) const
     {
-        storage = other.storage;
-        entries.reserve(other.entries.size());
-        for(auto entry: other.entries)
+        const Text& t = *text;
+        const uint64_t prefix = key_prefix(name.ptr(), name.size());
+        const auto found = std::lower_bound(sections.begin(), sections.end(), name,
+            [&t, prefix](const Section& a, const Slice<const char> b) {
+            return a.prefix < prefix || (a.prefix == prefix && compare(t.slice(a.name), b) < 0);
+        });
+        if(found != sections.end() && t.slice(found->name) == name)
         {
-            // Both key and value point to storage; they don't own their data.
-            // Our storage is a copy of other.storage, so we determine the positions of
-            // keys/values in storage and initialize our keys/values based on that.
-            const ptrdiff_t key_offset = entry.first - other.storage.data();
-            const ptrdiff_t val_offset = entry.second - other.storage.data();
-            const char* key   = storage.data() + key_offset;
-            const char* value = storage.data() + val_offset;
-            entries.push_back(std::pair<const char*, const char*>(key, value));
+            return found - sections.begin();
         }
+        return sections.size();
     }
 
+    /// Binary search for a key in entries [begin, end) (one section).
+    auto find_sorted(const size_t begin, const size_t end, const Slice<const char> key) const
+        -> decltype(entries.end())
+    {
+        // Find the first element *greater or equal* than key using binary search.
+        // Compare prefixes first; only look at the text if they're equal.
+        const Text& t = *text;
+        const uint64_t prefix = key_prefix(key.ptr(), key.size());
+        const auto section_end = entries.begin() + end;
+        auto lower_bound = std::lower_bound(entries.begin() + begin, section_end, key,
+            [&t, prefix](const Entry& a, const Slice<const char> b) {
+            return a.prefix < prefix || (a.prefix == prefix && compare(t.slice(a.key), b) < 0);
+        });
+
+        // If equal, we've found the key.
+        if(lower_bound != section_end && t.slice(lower_bound->key) == key)
+        {
+            return lower_bound;
+        }
+
+        // If greater, no such key in entries.
+        return entries.end();
+    }
+
+    /** Binary search for a group of keys at once, interleaving their searches.
+     *
+     * All searches run in lockstep with a branchless lower_bound; at each step we
+     * prefetch the middle entries of all searches and their keys before comparing any
+     * of them.
+     *
+     * Writes the index of the first entry *greater or equal* than each key (like
+     * lower_bound) to candidates, or HashIndex::NOT_FOUND if past the end.
+     */
+    void sorted_candidates(const Slice<const char>* const keys, const size_t count,
+                           uint32_t* const candidates) const
+    {
+        assert(count <= BATCH_GROUP);
+        const Entry* bases[BATCH_GROUP];
+        uint64_t prefixes[BATCH_GROUP];
+        for(size_t k = 0; k < count; ++k)
+        {
+            bases[k]    = entries.ptr();
+            prefixes[k] = key_prefix(keys[k].ptr(), keys[k].size());
+        }
+        // Compare by prefixes first; only look at the text if they're equal.
+        const auto less = [this](const Entry& entry, const uint64_t prefix,
+                                 const Slice<const char> key) {
+            return entry.prefix < prefix ||
+                   (entry.prefix == prefix && compare(this->key(entry), key) < 0);
+        };
+        size_t n = root_size();
+        while(n > 1)
+        {
+            const size_t half = n / 2;
+            for(size_t k = 0; k < count; ++k)
+            {
+                __builtin_prefetch(bases[k] + half);
+            }
+            for(size_t k = 0; k < count; ++k)
+            {
+                bases[k] = less(bases[k][half], prefixes[k], keys[k]) ? bases[k] + half
+                                                                      : bases[k];
+            }
+            n -= half;
+        }
+        for(size_t k = 0; k < count; ++k)
+        {
+            size_t index = bases[k] - entries.ptr();
+            index += n > 0 && less(*bases[k], prefixes[k], keys[k]);
+            candidates[k] = index < root_size() ? static_cast<uint32_t>(index)
+                                                : HashIndex::NOT_FOUND;
+        }
+    }
+
+    /// find() using eytzinger_index.
+    auto find_eytzinger(const Slice<const char> key) const -> decltype(entries.end())
+    {
+        const uint32_t found = eytzinger_index.lower_bound(key_prefix(key.ptr(), key.size()),
+                                                           [this, &key](const uint32_t e) {
+            return compare(text->slice(entries[e].key), key);
+        });
+        if(found != EytzingerIndex::NOT_FOUND && text->slice(entries[found].key) == key)
+        {
+            return entries.begin() + found;
+        }
+        return entries.end();
+    }
+
+    /// find() using perfect_hash.
+    auto find_perfect(const Slice<const char> key) const -> decltype(entries.end())
+    {
+        const uint32_t found = perfect_hash.find(key, [this, &key](const uint32_t e) {
+            return text->slice(entries[e].key) == key;
+        });
+        return found == PerfectHash::NOT_FOUND ? entries.end() : entries.begin() + found;
+    }
+
+    /// find() using hash_index. hash is hash_bytes() of key.
+    auto find_hashed(const Slice<const char> key, const uint64_t hash) const
+        -> decltype(entries.end())
+    {
+        const uint32_t found = hash_index.find(hash, [this, &key](const uint32_t e) {
+            return text->slice(entries[e].key) == key;
+        });
+        return found == HashIndex::NOT_FOUND ? entries.end() : entries.begin() + found;
+    }
+
+    /// Last c in data[0, size), or nullptr. Like memrchr(), which is a GNU extension.
+    static const char* find_last(const char* const data, size_t size, const char c)
+    {
+        while(size > 0)
+        {
+            if(data[--size] == c)
+            {
+                return data + size;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Find the section a changed part of text is in, for reparse().
+     *
+     * Looks for the last [section] header before position (a line start) in text.
+     *
+     * previous = CFG parsed from the previous version of text. Has the same headers in
+     *            the same order.
+     *
+     * Returns the index of the section in previous, or previous.sections.size() on error.
+     */
+    size_t section_before(const CFG& previous, const size_t position) const
+    {
+        if(previous.sections.size() == 1)
+        {
+            return 0;
+        }
+        // Look at lines with a '[', going back.
+        const char* const data = text->data();
+        size_t end = position;
+        while(const char* const bracket = find_last(data, end, '['))
+        {
+            const char* line_begin = bracket;
+            while(line_begin > data && line_begin[-1] != '\n')
+            {
+                --line_begin;
+            }
+            const char* const newline = static_cast<const char*>(
+                memchr(bracket, '\n', data + position - bracket));
+            const char* const line_end = newline == nullptr ? data + position : newline + 1;
+
+            bool found = false;
+            Span name, error;
+            const auto ignore_entry = [](Span, Span) {};
+            const auto header = [&found, &name](const Span header_name) {
+                found = true;
+                name  = header_name;
+                return true;
+            };
+            if(!scan_lines(line_begin, line_end - line_begin, ignore_entry, header, error))
+            {
+                return previous.sections.size();
+            }
+            if(found)
+            {
+                name.offset += static_cast<uint32_t>(line_begin - data);
+                return previous.find_section(text->slice(name));
+            }
+            end = line_begin - data;
+        }
+        return 0;
+    }
+
+    /** Parse text as a new version of the text of previous, reusing its entries.
+     *
+     * See reparse(). Returns false if we need to parse the whole text instead (a changed
+     * part adds/removes a section header, has an error or a duplicate key).
+     */
+    bool patch(const CFG& previous, Parsed& out) const
+    {
+        const Text& old_text = *previous.text;
+        const char* const data = text->data();
+        const std::vector<TextEdit> edits =
+            diff_lines(old_text.data(), old_text.size(), data, text->size());
+
+        // Scan changed parts. Removed parts must have no headers (so sections of other
+        // entries don't change) and added parts no headers and no errors.
+        const auto ignore_entry   = [](Span, Span) {};
+        const auto reject_header  = [](Span) { return false; };
+        const size_t section_count = previous.sections.size();
+        std::vector<std::vector<Entry>> added(section_count);
+        for(const TextEdit& edit: edits)
+        {
+            Span error;
+            if(!scan_lines(old_text.data() + edit.old_begin, edit.old_end - edit.old_begin,
+                           ignore_entry, reject_header, error))
+            {
+                return false;
+            }
+            const size_t s = section_before(previous, edit.new_begin);
+            if(s == section_count)
+            {
+                return false;
+            }
+            std::vector<Entry>& section_added = added[s];
+            const uint32_t base = edit.new_begin;
+            const auto add_entry = [&section_added, data, base](Span key, Span value) {
+                key.offset   += base;
+                value.offset += base;
+                section_added.push_back(make_entry(data, key, value));
+            };
+            if(!scan_lines(data + edit.new_begin, edit.new_end - edit.new_begin, add_entry,
+                           reject_header, error))
+            {
+                return false;
+            }
+        }
+
+        // New offset of an old offset outside edits: old offset + total size change of
+        // all edits before it. Returns UINT32_MAX if the offset is in a changed part.
+        std::vector<int64_t> delta_after(edits.size());
+        int64_t delta = 0;
+        for(size_t e = 0; e < edits.size(); ++e)
+        {
+            delta += static_cast<int64_t>(edits[e].new_end - edits[e].new_begin) -
+                     static_cast<int64_t>(edits[e].old_end - edits[e].old_begin);
+            delta_after[e] = delta;
+        }
+        const auto moved = [&edits, &delta_after](const uint32_t offset) -> uint32_t {
+            const auto after = std::upper_bound(edits.begin(), edits.end(), offset,
+                [](const uint32_t o, const TextEdit& edit) { return o < edit.old_begin; });
+            if(after == edits.begin())
+            {
+                return offset;
+            }
+            const size_t e = after - edits.begin() - 1;
+            if(offset < edits[e].old_end)
+            {
+                return UINT32_MAX;
+            }
+            return static_cast<uint32_t>(offset + delta_after[e]);
+        };
+
+        // Kept entries of each section are still sorted; merge added entries into them.
+        const KeyCompare key_compare{*text};
+        out.entries.reserve(previous.entries.size());
+        for(size_t s = 0; s < section_count; ++s)
+        {
+            const Section& old_section = previous.sections[s];
+            std::vector<Entry>& section_added = added[s];
+            Entry duplicate;
+            if(!sort_entries(section_added.data(), section_added.size(), duplicate))
+            {
+                return false;
+            }
+            Section section = old_section;
+            section.name.offset = old_section.name.length == 0 ? 0
+                                                               : moved(old_section.name.offset);
+            section.begin = static_cast<uint32_t>(out.entries.size());
+            auto next_added = section_added.begin();
+            for(size_t e = old_section.begin; e < old_section.end; ++e)
+            {
+                Entry entry = previous.entries[e];
+                const uint32_t offset = moved(entry.key.offset);
+                if(offset == UINT32_MAX)
+                {
+                    continue;
+                }
+                entry.value.offset = entry.value.offset - entry.key.offset + offset;
+                entry.key.offset   = offset;
+                int order = 1;
+                while(next_added != section_added.end() &&
+                      (order = key_compare(*next_added, entry)) < 0)
+                {
+                    out.entries.push_back(*next_added++);
+                }
+                if(order == 0)
+                {
+                    return false;
+                }
+                out.entries.push_back(entry);
+            }
+            out.entries.insert(out.entries.end(), next_added, section_added.end());
+            section.end = static_cast<uint32_t>(out.entries.size());
+            out.sections.push_back(section);
+        }
+        return true;
+    }
+
+    /// Parse text (already loaded) and set up entries and sections.
+    void parse_text(const std::string& filename, const unsigned threads)
+    {
+        const unsigned thread_count = resolve_threads(threads);
+        std::shared_ptr<Parsed> result(new Parsed());
+        valid = thread_count > 1 ? parse_parallel(filename, thread_count, *result)
+                                 : parse(filename, *result);
+        use_parsed(result);
+    }
+
+    /// Point entries and sections to result.
+    void use_parsed(const std::shared_ptr<const Parsed>& result)
+    {
+        parsed      = result;
+        entries     = Slice<const Entry>(result->entries);
+        sections    = Slice<const Section>(result->sections);
+        typed_cache = std::make_shared<TypedCache>(entries.size());
+        // From now on, the text is only read at random by lookups.
+        text->end_sequential();
+    }
+
+    /** Do entries, sections and the hash index of a loaded snapshot stay in its bounds?
+     *
+     * Checked on every load (not only with the checksum), so a damaged snapshot can't
+     * make find(), key() or value() read past its heap or entries. O(entries + slots).
+     */
+    bool snapshot_in_bounds(const size_t heap_size) const
+    {
+        const auto in_heap = [heap_size](const Span span)
+        {
+            return static_cast<uint64_t>(span.offset) + span.length <= heap_size;
+        };
+        for(const Entry& entry: entries)
+        {
+            if(!in_heap(entry.key) || !in_heap(entry.value))
+            {
+                return false;
+            }
+        }
+        for(const Section& section: sections)
+        {
+            if(!in_heap(section.name) || section.begin > section.end ||
+               section.end > entries.size())
+            {
+                return false;
+            }
+        }
+        return hash_index.check(entries.size());
+    }
+
+public:
+    CFG():valid(false) {}
+
+    /** Load and parse a CFG file.
+     *
+     * filename = File to parse.
+     * loader   = How to get the file into memory.
+     * threads  = Number of threads to parse with; 0 means one per hardware thread.
+     *            Small files are parsed with fewer threads.
+     */
+    CFG(const std::string& filename, const Loader loader = Loader::IFSTREAM,
+        const unsigned threads = 1) noexcept
+    {
+        std::shared_ptr<Text> loaded(new Text());
+        if(!loaded->load(filename, loader))
+        {
+            valid = false;
+            return;
+        }
+        text = loaded;
+        // Spans use 32-bit offsets.
+        if(text->size() > UINT32_MAX)
+        {
+            std::cerr << "ERROR: file too large: " << filename << std::endl;
+            valid = false;
+            return;
+        }
+
+        parse_text(filename, threads);
+    }
+
+    // Copying only copies indices; text and entries are immutable and shared by all copies.
+    CFG(const CFG& other) = default;
+
     // swap(), operator= and CFG(CFG&&) are used to implement the copy-and-swap idiom
     // (see http://stackoverflow.com/questions/3279543/what-is-the-copy-and-swap-idiom)
     friend void swap(CFG& first, CFG& second) noexcept
     {
-        first.storage.swap(second.storage);
-        first.entries.swap(second.entries);
+        first.text.swap(second.text);
+        std::swap(first.entries, second.entries);
+        std::swap(first.sections, second.sections);
+        first.parsed.swap(second.parsed);
+        std::swap(first.hash_index, second.hash_index);
+        std::swap(first.eytzinger_index, second.eytzinger_index);
+        std::swap(first.perfect_hash, second.perfect_hash);
+        std::swap(first.bloom_filter, second.bloom_filter);
+        first.typed_cache.swap(second.typed_cache);
+        first.array_elements.swap(second.array_elements);
+        first.entry_arrays.swap(second.entry_arrays);
         std::swap(first.valid, second.valid);
     }
 
@@ -314,30 +1225,606 @@ public:
         return *this;
     }
 
+    /** Load a snapshot compiled by save_snapshot() (see cfgc.cpp and snapshot.h).
+     *
+     * The snapshot is mapped and used in place: nothing is parsed, sorted or copied, and
+     * find() uses the hash index saved in the snapshot.
+     *
+     * snapshot = Snapshot file.
+     * source   = The text file the snapshot was compiled from. Only its size and
+     *            modification time are read.
+     * checksum = Verify the checksum of the snapshot? This reads the whole snapshot, and
+     *            for large files takes much longer than the rest of the load. Snapshots
+     *            are written atomically, so skipping it only risks not noticing a
+     *            snapshot damaged after it was written. Without it, spans and indices
+     *            are still checked to be in bounds, so a damaged snapshot may give wrong
+     *            values but never reads outside the snapshot.
+     *
+     * Returns an invalid CFG (without printing an error) if the snapshot can't be read,
+     * is corrupted or was compiled by a different version, or is stale: the source has
+     * changed or is gone. Parse the source instead in that case.
+     */
+    static CFG load_snapshot(const std::string& snapshot, const std::string& source,
+                             const bool checksum = true)
+    {
+        CFG cfg;
+        SourceStamp stamp;
+        std::shared_ptr<Text> loaded(new Text());
+        SnapshotHeader header;
+        if(!source_stamp(source, stamp) || !loaded->load(snapshot, Loader::MMAP) ||
+           !read_snapshot_header(loaded->data(), loaded->size(), stamp, checksum, header))
+        {
+            return cfg;
+        }
+        if(header.entries_size % sizeof(Entry) != 0 ||
+           header.sections_size % sizeof(Section) != 0 || header.sections_size == 0 ||
+           header.heap_size > UINT32_MAX)
+        {
+            return cfg;
+        }
+
+        const char* const data = loaded->data();
+        if(!cfg.hash_index.view(data + header.hash_offset, header.hash_size))
+        {
+            return cfg;
+        }
+        cfg.entries  = Slice<const Entry>(reinterpret_cast<const Entry*>(
+                                              data + header.entries_offset),
+                                          header.entries_size / sizeof(Entry));
+        cfg.sections = Slice<const Section>(reinterpret_cast<const Section*>(
+                                                data + header.sections_offset),
+                                            header.sections_size / sizeof(Section));
+        if(!cfg.snapshot_in_bounds(header.heap_size))
+        {
+            // Don't leave the invalid CFG pointing into the unmapped snapshot.
+            return CFG();
+        }
+        // Keys and values are spans of the string heap.
+        loaded->narrow(header.heap_offset, header.heap_size);
+        loaded->end_sequential();
+        cfg.text        = loaded;
+        cfg.typed_cache = std::make_shared<TypedCache>(cfg.entries.size());
+        cfg.valid       = true;
+        return cfg;
+    }
+
+    /** Parse a new version of the file this CFG was parsed from, reparsing only what
+     * changed.
+     *
+     * Changed lines are found by comparing the versions, skipping the common prefix and
+     * suffix and comparing the rest by hashes of chunks of lines (see line-chunks.h).
+     * Only changed lines are scanned; entries of unchanged lines are kept (moved to their
+     * new offsets) and new entries are merged into each section instead of sorting
+     * everything again.
+     *
+     * The result is the same as CFG(filename, loader, threads), errors included: if a
+     * change adds or removes a [section] header, has an error or a duplicate key, or if
+     * this CFG is invalid or loaded from a snapshot, the whole file is parsed. Indices,
+     * arrays and converted values are not carried over.
+     *
+     * If this CFG was loaded with Loader::MMAP, the file must have been replaced (written
+     * elsewhere and renamed), not rewritten in place: that would change our text too.
+     */
+    CFG reparse(const std::string& filename, const Loader loader = Loader::IFSTREAM,
+                const unsigned threads = 1) const
+    {
+        if(!valid || parsed == nullptr)
+        {
+            return CFG(filename, loader, threads);
+        }
+        CFG result;
+        std::shared_ptr<Text> loaded(new Text());
+        if(!loaded->load(filename, loader))
+        {
+            return result;
+        }
+        result.text = loaded;
+        if(loaded->size() > UINT32_MAX)
+        {
+            std::cerr << "ERROR: file too large: " << filename << std::endl;
+            return result;
+        }
+        std::shared_ptr<Parsed> patched(new Parsed());
+        if(!result.patch(*this, *patched))
+        {
+            result.parse_text(filename, threads);
+            return result;
+        }
+        result.use_parsed(patched);
+        result.valid = true;
+        return result;
+    }
+
+    /** Make a CFG of key-value pairs sorted by section name, then by key, with no
+     * duplicate keys in a section - e.g. entries merged from other CFGs (see
+     * config-overlay.h).
+     *
+     * Nothing is parsed or sorted. Keys, values and section names are copied into a new
+     * text, each value right after its key.
+     *
+     * next = Called as next(section, key, value) with Slice<const char>& arguments:
+     *        writes the next pair to them and returns true, or returns false after the
+     *        last pair. The unnamed section has an empty name and must come first.
+     *
+     * Returns an invalid CFG if the pairs are too large for 32-bit spans.
+     */
+    template<typename Next>
+    static CFG from_sorted(const Next& next)
+    {
+        CFG cfg;
+        std::vector<char> heap;
+        const auto add = [&heap](const Slice<const char> string) {
+            const Span span{static_cast<uint32_t>(heap.size()),
+                            static_cast<uint32_t>(string.size())};
+            heap.insert(heap.end(), string.begin(), string.end());
+            return span;
+        };
+        const auto heap_slice = [&heap](const Span span) {
+            return Slice<const char>(heap.data() + span.offset, span.length);
+        };
+
+        std::shared_ptr<Parsed> result(new Parsed());
+        result->sections.push_back(Section{0, Span{0, 0}, 0, 0});
+        Slice<const char> section(nullptr, 0), key(nullptr, 0), value(nullptr, 0);
+        while(next(section, key, value))
+        {
+            const Section& last = result->sections.back();
+            const uint32_t count = static_cast<uint32_t>(result->entries.size());
+            // The unnamed section's name is not compared: heap.data() may still be null.
+            const bool unnamed = last.name.length == 0;
+            if(!(unnamed ? section.empty() : heap_slice(last.name) == section))
+            {
+                assert((unnamed || compare(heap_slice(last.name), section) < 0) &&
+                       "sections not sorted");
+                result->sections.push_back(Section{key_prefix(section.ptr(), section.size()),
+                                                   add(section), count, count});
+            }
+            assert((result->sections.back().begin == count ||
+                    compare(heap_slice(result->entries.back().key), key) < 0) &&
+                   "keys not sorted or duplicate");
+            Entry entry;
+            entry.prefix = key_prefix(key.ptr(), key.size());
+            entry.key    = add(key);
+            entry.value  = add(value);
+            result->entries.push_back(entry);
+            result->sections.back().end = count + 1;
+        }
+        if(heap.size() > UINT32_MAX)
+        {
+            return cfg;
+        }
+
+        std::shared_ptr<Text> built(new Text());
+        built->assign(std::move(heap));
+        cfg.text = built;
+        cfg.use_parsed(result);
+        cfg.valid = true;
+        return cfg;
+    }
+
+    /** Compile this CFG into a snapshot file that load_snapshot() can load.
+     *
+     * The snapshot contains a compacted copy of keys, values and section names (without
+     * comments, whitespace and separators), the sorted entries and sections, and a hash
+     * index of the unnamed section. Writes to a temporary file first, then renames it to
+     * filename.
+     *
+     * filename = File to write.
+     * source   = Stamp of the source text, taken (with source_stamp()) *before* loading
+     *            it: load_snapshot() rejects the snapshot if the source's stamp changes.
+     *
+     * Returns false if the file could not be written.
+     */
+    bool save_snapshot(const std::string& filename, const SourceStamp& source) const
+    {
+        assert(valid);
+        std::vector<char> heap;
+        const auto add = [&heap](const Slice<const char> string) {
+            const Span span{static_cast<uint32_t>(heap.size()),
+                            static_cast<uint32_t>(string.size())};
+            heap.insert(heap.end(), string.begin(), string.end());
+            return span;
+        };
+        std::vector<Section> heap_sections(sections.begin(), sections.end());
+        for(Section& section: heap_sections)
+        {
+            section.name = add(text->slice(section.name));
+        }
+        // Each value right after its key: find() usually reads both.
+        std::vector<Entry> heap_entries(entries.begin(), entries.end());
+        for(Entry& entry: heap_entries)
+        {
+            const auto k = key(entry);
+            const auto v = value(entry);
+            entry.key    = add(k);
+            entry.value  = add(v);
+        }
+        HashIndex index;
+        index.build(root_size(), [this](const size_t e) {
+            const auto k = key(entries[e]);
+            return hash_bytes(k.ptr(), k.size());
+        });
+
+        SnapshotHeader header = snapshot_header(source);
+        std::vector<char> image(sizeof(header));
+        header.heap_size       = heap.size();
+        header.heap_offset     = snapshot_append(image, heap.data(), heap.size());
+        header.entries_size    = heap_entries.size() * sizeof(Entry);
+        header.entries_offset  = snapshot_append(image, heap_entries.data(), header.entries_size);
+        header.sections_size   = heap_sections.size() * sizeof(Section);
+        header.sections_offset = snapshot_append(image, heap_sections.data(),
+                                                 header.sections_size);
+        header.hash_size       = index.bytes();
+        header.hash_offset     = snapshot_append(image, index.data(), header.hash_size);
+        return write_snapshot(filename, header, image);
+    }
+
 
     bool is_valid() const
     {
         return valid;
     }
 
-    /* auto find(const std::string& key) const -> decltype(entries.end()) */
-    auto find(const char* const key) const -> decltype(entries.end())
+    /// Get the key of an entry.
+    Slice<const char> key(const Entry& entry) const
+    {
+        return text->slice(entry.key);
+    }
+
+    /// Get the value of an entry.
+    Slice<const char> value(const Entry& entry) const
+    {
+        return text->slice(entry.value);
+    }
+
+    /** Get the value of an entry converted to T: int64_t, double or bool.
+     *
+     * Values are parsed without allocating and without depending on the locale (see
+     * parse-value.h). Bools may be yes/true/1 or no/false/0. The result is cached, so
+     * later reads of the same entry (also from copies of this CFG) don't parse again.
+     *
+     * entry  = An entry of this CFG.
+     * result = The converted value is written here.
+     *
+     * Returns false if the value can't be converted to T.
+     */
+    template<typename T>
+    bool get(const Entry& entry, T& result) const
     {
         assert(valid);
-        // Find the first element *greater or equal* than key using binary search.
-        auto lower_bound = std::lower_bound(entries.begin(), entries.end(), key,
-            [](const std::pair<const char*, const char*>& a, const char* const b) {
-            return strcmp(a.first, b) < 0;
+        assert(&entry >= entries.ptr() && &entry < entries.ptr() + entries.size());
+        const auto v = value(entry);
+        return typed_cache->get(&entry - entries.ptr(), v.ptr(), v.size(), result);
+    }
+
+    /** Recognize arrays and multi-value tags, so array() can return their values.
+     *
+     * An array is an entry "name = N" followed by entries "name1" to "nameN" in the same
+     * section (the elements stay ordinary entries too). A multi-value tag is an entry
+     * with comma-separated values, "name = a, b, c". The values of each array are stored
+     * contiguously in index order, so iterating an array walks adjacent memory instead
+     * of looking up N keys.
+     */
+    void build_arrays()
+    {
+        assert(valid);
+        array_elements.clear();
+        entry_arrays.assign(entries.size(), Span{0, 0});
+        for(const Section& section: sections)
+        {
+            for(size_t e = section.begin; e < section.end; ++e)
+            {
+                if(!add_array(e, section.end))
+                {
+                    add_multi_value(e);
+                }
+            }
+        }
+    }
+
+    /** Get values of an array or a multi-value tag, in order.
+     *
+     * Requires build_arrays(). Returns an empty slice if entry is neither.
+     */
+    Slice<const Slice<const char>> array(const Entry& entry) const
+    {
+        assert(valid);
+        assert(entry_arrays.size() == entries.size());
+        assert(&entry >= entries.ptr() && &entry < entries.ptr() + entries.size());
+        const Span range = entry_arrays[&entry - entries.ptr()];
+        return Slice<const Slice<const char>>(array_elements.data() + range.offset,
+                                              range.length);
+    }
+
+    /** Build a hash index to speed up find().
+     *
+     * After this, find() hashes the key and usually touches a single cache line of the
+     * index instead of binary searching entries. Iteration is still in sorted order.
+     */
+    void build_hash_index()
+    {
+        assert(valid);
+        hash_index.build(root_size(), [this](const size_t e) {
+            const auto k = key(entries[e]);
+            return hash_bytes(k.ptr(), k.size());
         });
+    }
 
-        // If equal, we've found the key.
-        if(lower_bound->first == key)
+    /** Build an Eytzinger search index to speed up find().
+     *
+     * find() then does a branchless binary search over a copy of the entries' key
+     * prefixes in BFS order, with prefetching. Uses less memory than a hash index. Iteration is
+     * still in sorted order.
+     */
+    void build_eytzinger_index()
+    {
+        assert(valid);
+        eytzinger_index.build(root_size(), [this](const size_t e) {
+            return entries[e].prefix;
+        });
+    }
+
+    /** Build a minimal perfect hash of keys, for configs that won't change anymore.
+     *
+     * After this, find() needs one hash, one slot read and (if the slot's fingerprint
+     * matches) one key comparison. Most missing keys are rejected by the fingerprint
+     * without touching any keys. Replaces the hash index, if any. Iteration is still in
+     * sorted order.
+     */
+    void freeze()
+    {
+        assert(valid);
+        perfect_hash.build(root_size(), [this](const size_t e) {
+            return key(entries[e]);
+        });
+        hash_index = HashIndex();
+    }
+
+    /** Build a blocked Bloom filter of keys (see bloom-filter.h), to speed up find() of
+     * keys that are *not* in the config.
+     *
+     * find() then hashes the key and checks the filter before using any index; most
+     * missing keys are rejected by one cache line read, without a search. Found keys
+     * take a bit longer (the check, and hashing if no hash index is built).
+     *
+     * bits_per_key = Size of the filter; each extra bit per key roughly halves the
+     *                missing keys that get past it (about 1% with the default).
+     */
+    void build_bloom_filter(const unsigned bits_per_key = BloomFilter::DEFAULT_BITS_PER_KEY)
+    {
+        assert(valid);
+        bloom_filter.build(root_size(), [this](const size_t e) {
+            const auto k = key(entries[e]);
+            return hash_bytes(k.ptr(), k.size());
+        }, bits_per_key);
+    }
+
+    /// Size of the optional lookup indices in bytes (not including entries).
+    size_t index_bytes() const
+    {
+        return hash_index.bytes() + eytzinger_index.bytes() + perfect_hash.bytes() +
+               bloom_filter.bytes();
+    }
+
+    /** Find a key in the unnamed section (entries before the first [section] header).
+     *
+     * Returns end() if not found. Uses the optional indices and filter, if built.
+     */
+    auto find(const Slice<const char> key) const -> decltype(entries.end())
+    {
+        assert(valid);
+        uint64_t hash = 0;
+        if(!bloom_filter.empty() || (perfect_hash.empty() && !hash_index.empty()))
         {
-            return lower_bound;
+            hash = hash_bytes(key.ptr(), key.size());
+        }
+        if(!bloom_filter.empty() && !bloom_filter.may_contain(hash))
+        {
+            return entries.end();
+        }
+        if(!perfect_hash.empty())
+        {
+            return find_perfect(key);
+        }
+        if(!hash_index.empty())
+        {
+            return find_hashed(key, hash);
+        }
+        return eytzinger_index.empty() ? find_sorted(0, root_size(), key)
+                                       : find_eytzinger(key);
+    }
+
+    /** Find a key in a section.
+     *
+     * Binary searches the section table, then only the entries of the section. The
+     * unnamed section has an empty name.
+     *
+     * Returns end() if there is no such section or key.
+     */
+    auto find(const Slice<const char> section, const Slice<const char> key) const
+        -> decltype(entries.end())
+    {
+        assert(valid);
+        const size_t s = find_section(section);
+        if(s == sections.size())
+        {
+            return entries.end();
         }
+        return find_sorted(sections[s].begin, sections[s].end, key);
+    }
 
-        // If greater, no such key in entries.
-        return entries.end();
+    /** Look up many keys at once.
+     *
+     * Faster than calling find() for each key: lookups of BATCH_GROUP keys are
+     * interleaved and their memory accesses prefetched, so the CPU waits for many cache
+     * misses at once instead of one after another. Works with any index.
+     *
+     * keys    = Keys to look for.
+     * results = Iterators to found entries (or end()) are written here. Must be at least
+     *           as long as keys.
+     */
+    void find_batch(const Slice<const Slice<const char>> keys,
+                    Slice<const_iterator> results) const
+    {
+        assert(valid);
+        assert(results.size() >= keys.size());
+        for(size_t start = 0; start < keys.size(); start += BATCH_GROUP)
+        {
+            const size_t count = std::min(BATCH_GROUP, keys.size() - start);
+            const Slice<const char>* const group = keys.ptr() + start;
+            const_iterator* const group_results  = results.ptr_mutable() + start;
+            if(count == 1)
+            {
+                // Nothing to interleave with.
+                group_results[0] = find(group[0]);
+                continue;
+            }
+
+            // Find a candidate entry for each key.
+            uint64_t hashes[BATCH_GROUP];
+            if(!hash_index.empty() || !bloom_filter.empty())
+            {
+                for(size_t k = 0; k < count; ++k)
+                {
+                    hashes[k] = hash_bytes(group[k].ptr(), group[k].size());
+                }
+            }
+            uint32_t candidates[BATCH_GROUP];
+            if(!perfect_hash.empty())
+            {
+                perfect_hash.candidates(group, count, candidates);
+            }
+            else if(!hash_index.empty())
+            {
+                hash_index.candidates(hashes, count, candidates);
+            }
+            else
+            {
+                sorted_candidates(group, count, candidates);
+            }
+            // Keys rejected by the filter are not here; don't touch their entries.
+            if(!bloom_filter.empty())
+            {
+                for(size_t k = 0; k < count; ++k)
+                {
+                    if(!bloom_filter.may_contain(hashes[k]))
+                    {
+                        candidates[k] = HashIndex::NOT_FOUND;
+                    }
+                }
+            }
+
+            // Check if candidates match, prefetching entries and their keys first.
+            for(size_t k = 0; k < count; ++k)
+            {
+                if(candidates[k] != HashIndex::NOT_FOUND)
+                {
+                    __builtin_prefetch(&entries[candidates[k]]);
+                }
+            }
+            for(size_t k = 0; k < count; ++k)
+            {
+                if(candidates[k] != HashIndex::NOT_FOUND)
+                {
+                    __builtin_prefetch(text->data() + entries[candidates[k]].key.offset);
+                }
+            }
+            for(size_t k = 0; k < count; ++k)
+            {
+                const uint32_t c = candidates[k];
+                if(c != HashIndex::NOT_FOUND && key(entries[c]) == group[k])
+                {
+                    group_results[k] = entries.begin() + c;
+                }
+                else if(c != HashIndex::NOT_FOUND && perfect_hash.empty() && !hash_index.empty())
+                {
+                    // Fingerprint collision; the key may still be further in the index.
+                    group_results[k] = find_hashed(group[k], hashes[k]);
+                }
+                else
+                {
+                    group_results[k] = entries.end();
+                }
+            }
+        }
+    }
+
+    auto find(const char* const key) const -> decltype(entries.end())
+    {
+        return find(Slice<const char>(key, strlen(key)));
+    }
+
+    auto find(const char* const section, const char* const key) const
+        -> decltype(entries.end())
+    {
+        return find(Slice<const char>(section, strlen(section)),
+                    Slice<const char>(key, strlen(key)));
+    }
+
+    /** Look up a key in the unnamed section once, to read it later with at().
+     *
+     * Returns NO_KEY if not found.
+     */
+    KeyId resolve(const Slice<const char> key) const
+    {
+        const auto found = find(key);
+        return found == end() ? NO_KEY : static_cast<KeyId>(found - begin());
+    }
+
+    /// Look up a key in a section once, to read it later with at(). See resolve(key).
+    KeyId resolve(const Slice<const char> section, const Slice<const char> key) const
+    {
+        const auto found = find(section, key);
+        return found == end() ? NO_KEY : static_cast<KeyId>(found - begin());
+    }
+
+    /// Get the entry with an ID from resolve(); end() for NO_KEY. O(1), no lookup.
+    auto at(const KeyId id) const -> decltype(entries.begin())
+    {
+        assert(valid);
+        assert(id == NO_KEY || id < entries.size());
+        return id == NO_KEY ? entries.end() : entries.begin() + id;
+    }
+
+    /// Number of sections, including the unnamed section (section 0).
+    size_t section_count() const
+    {
+        assert(valid);
+        return sections.size();
+    }
+
+    /// Name of section i. Sections are sorted by name.
+    Slice<const char> section_name(const size_t i) const
+    {
+        assert(valid);
+        return text->slice(sections[i].name);
+    }
+
+    /// First entry of section i. Entries of a section are sorted by key.
+    auto section_begin(const size_t i) const -> decltype(entries.begin())
+    {
+        assert(valid);
+        return entries.begin() + sections[i].begin;
+    }
+
+    /// Past the last entry of section i.
+    auto section_end(const size_t i) const -> decltype(entries.begin())
+    {
+        assert(valid);
+        return entries.begin() + sections[i].end;
+    }
+
+    /// Index of the section an entry is in.
+    size_t section_of(const_iterator entry) const
+    {
+        assert(valid);
+        assert(entry >= entries.begin() && entry < entries.end());
+        const uint32_t e = static_cast<uint32_t>(entry - entries.begin());
+        // Sections cover entries in order, so find the first one ending after entry.
+        return std::upper_bound(sections.begin(), sections.end(), e,
+            [](const uint32_t index, const Section& section) {
+            return index < section.end;
+        }) - sections.begin();
     }
 
     auto begin() const -> decltype(entries.begin())
@@ -359,5 +1846,16 @@ public:
     }
 };
 
+/// Compare keys of entries of two different CFGs, in the order CFG sorts them.
+inline int compare_keys(const CFG& a, const Entry& a_entry, const CFG& b, const Entry& b_entry)
+{
+    // Key prefixes compare like the first 8 bytes of keys; most keys differ there.
+    if(a_entry.prefix != b_entry.prefix)
+    {
+        return a_entry.prefix < b_entry.prefix ? -1 : 1;
+    }
+    return compare(a.key(a_entry), b.key(b_entry));
+}
+
 
 #endif /* end of include guard: CFG5_NOALLOC_H_VIXAU86T */
@@ -10,11 +10,24 @@
 #include "cfg5-noalloc.h"
 #include "diy.h"
 
+#ifdef ZONE_REPORT
+#include "call-tree.h"
+#include "frame-capture.h"
+#include "trace-export.h"
+#endif
+
 
 int main(int argc, const char* const argv[])
 {
     // PRINT_ZONES = true;
 
+#ifdef ZONE_REPORT
+    // Report of zones at exit. Build with -DZONE_REPORT=CallTreeReport for a call tree,
+    // -DZONE_REPORT=SpikeReport for zones of passes much slower than usual, or
+    // -DZONE_REPORT=TraceFile for a trace.json to open in a timeline viewer.
+    ZONE_REPORT report;
+#endif
+
     if(argc < 3)
     {
         std::cerr << "ERROR: need args. " << std::endl;
@@ -42,6 +55,10 @@ int main(int argc, const char* const argv[])
     CFG cfg;
     for(unsigned t = 0; t < times; ++t)
     {
+#ifdef ZONE_REPORT
+        Frame frame;
+#endif
+
         {
             Zone zone("parsing");
             cfg = CFG(filename);
@@ -53,24 +70,33 @@ int main(int argc, const char* const argv[])
             return 1;
         }
 
-        std::vector<const char*> keys;
+        // Section names and keys of all entries.
+        std::vector<Slice<const char>> sections, keys;
+        sections.reserve(cfg.size());
         keys.reserve(cfg.size());
 
         {
             Zone zone("iteration");
-            for(auto& key_value: cfg)
+            for(size_t s = 0; s < cfg.section_count(); ++s)
             {
-                keys.push_back(key_value.first);
+                for(auto entry = cfg.section_begin(s); entry != cfg.section_end(s); ++entry)
+                {
+                    sections.push_back(cfg.section_name(s));
+                    keys.push_back(cfg.key(*entry));
+                }
             }
         }
 
         {
             Zone zone("random access");
-            for(const char* const key: keys)
+            for(size_t k = 0; k < keys.size(); ++k)
             {
-                const auto found = cfg.find(key);
-                assert(strcmp(key, found->first) == 0);
-                workDummy = std::string(key) + "=" + found->second ;
+                const auto& key  = keys[k];
+                const auto found = cfg.find(sections[k], key);
+                assert(cfg.key(*found) == key);
+                const auto value = cfg.value(*found);
+                workDummy = std::string(key.ptr(), key.size()) + "="
+                          + std::string(value.ptr(), value.size());
             }
         }
 
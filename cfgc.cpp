@@ -0,0 +1,50 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// cfgc: compiles a CFG text file into a binary snapshot that CFG::load_snapshot() can
+// load without parsing (see snapshot.h).
+
+#include <iostream>
+#include <string>
+
+#include "cfg5-noalloc.h"
+
+
+int main(int argc, const char* const argv[])
+{
+    if(argc < 3)
+    {
+        std::cerr << "ERROR: need args. " << std::endl;
+        std::cerr << "Example: ./cfgc huge.cfg huge.cfgsnap " << std::endl;
+        return 1;
+    }
+
+    const char* const source   = argv[1];
+    const char* const snapshot = argv[2];
+
+    // Stamp before parsing so changes made while we parse make the snapshot stale.
+    SourceStamp stamp;
+    if(!source_stamp(source, stamp))
+    {
+        std::cerr << "ERROR: Failed to open file " << source << std::endl;
+        return 1;
+    }
+
+    const CFG cfg(source, Loader::MMAP, 0);
+    if(!cfg.is_valid())
+    {
+        std::cerr << "ERROR: Failed to open or parse file " << source << std::endl;
+        return 1;
+    }
+
+    if(!cfg.save_snapshot(snapshot, stamp))
+    {
+        std::cerr << "ERROR: Failed to write snapshot " << snapshot << std::endl;
+        return 1;
+    }
+    std::cout << "Compiled " << cfg.size() << " entries in " << cfg.section_count()
+              << " sections from " << source << " to " << snapshot << std::endl;
+    return 0;
+}
@@ -0,0 +1,158 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CONFIG_DIFF_H_TKWQXZRD
+#define CONFIG_DIFF_H_TKWQXZRD
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include "cfg5-noalloc.h"
+
+/** Differences between two versions of a config: keys added, removed or changed.
+ *
+ * Sections of a CFG are sorted by name and entries of each section by key, so diff()
+ * walks both CFGs once side by side, like the merge step of a merge sort, instead of
+ * calling find() for every key. Nothing is allocated: each difference is passed to a
+ * callback as a Change pointing into the two CFGs.
+ */
+
+
+/// Kinds of differences found by diff().
+enum class ChangeKind
+{
+    /// The key is only in the new CFG.
+    ADDED,
+    /// The key is only in the old CFG.
+    REMOVED,
+    /// The key is in both CFGs, with different values.
+    CHANGED
+};
+
+/// A difference between two CFGs. Slices and entries point into the CFGs.
+struct Change
+{
+    ChangeKind kind;
+    // Name of the section of the key; empty for the unnamed section.
+    Slice<const char> section;
+    Slice<const char> key;
+    // Entry of the key in the old CFG; nullptr if ADDED.
+    const Entry* old_entry;
+    // Entry of the key in the new CFG; nullptr if REMOVED.
+    const Entry* new_entry;
+};
+
+/// Do entries of two different CFGs have the same value?
+inline bool same_value(const CFG& a, const Entry& a_entry, const CFG& b, const Entry& b_entry)
+{
+    if(a_entry.value.length != b_entry.value.length)
+    {
+        return false;
+    }
+    const auto a_value = a.value(a_entry);
+    const auto b_value = b.value(b_entry);
+    // Copies of a CFG share their text.
+    return a_value.ptr() == b_value.ptr() ||
+           0 == memcmp(a_value.ptr(), b_value.ptr(), a_value.size());
+}
+
+/** Merge entries [a_begin, a_end) of a with [b_begin, b_end) of b (one section of each),
+ * passing differences to visit.
+ *
+ * Returns the number of differences.
+ */
+template<typename Visitor>
+size_t diff_entries(const CFG& a, CFG::const_iterator a_begin, const CFG::const_iterator a_end,
+                    const CFG& b, CFG::const_iterator b_begin, const CFG::const_iterator b_end,
+                    const Slice<const char> section, const Visitor& visit)
+{
+    size_t changes = 0;
+    while(a_begin != a_end && b_begin != b_end)
+    {
+        const int order = compare_keys(a, *a_begin, b, *b_begin);
+        if(order < 0)
+        {
+            visit(Change{ChangeKind::REMOVED, section, a.key(*a_begin), a_begin, nullptr});
+            ++a_begin;
+            ++changes;
+        }
+        else if(order > 0)
+        {
+            visit(Change{ChangeKind::ADDED, section, b.key(*b_begin), nullptr, b_begin});
+            ++b_begin;
+            ++changes;
+        }
+        else
+        {
+            if(!same_value(a, *a_begin, b, *b_begin))
+            {
+                visit(Change{ChangeKind::CHANGED, section, b.key(*b_begin), a_begin, b_begin});
+                ++changes;
+            }
+            ++a_begin;
+            ++b_begin;
+        }
+    }
+    for(; a_begin != a_end; ++a_begin, ++changes)
+    {
+        visit(Change{ChangeKind::REMOVED, section, a.key(*a_begin), a_begin, nullptr});
+    }
+    for(; b_begin != b_end; ++b_begin, ++changes)
+    {
+        visit(Change{ChangeKind::ADDED, section, b.key(*b_begin), nullptr, b_begin});
+    }
+    return changes;
+}
+
+/** Find keys added, removed or changed between two versions of a config.
+ *
+ * Keys are compared per section: a key moved to another section is removed from one and
+ * added to the other. Changes are reported in order of sections, then keys.
+ *
+ * Linear in the number of entries of both CFGs and allocates nothing. Keys are compared
+ * by their prefixes first and values by their lengths first, so most entries are
+ * compared without touching their text.
+ *
+ * old_cfg = The old version. Must be valid.
+ * new_cfg = The new version. Must be valid.
+ * visit   = Called with a const Change& for each difference.
+ *
+ * Returns the number of differences.
+ */
+template<typename Visitor>
+size_t diff(const CFG& old_cfg, const CFG& new_cfg, const Visitor& visit)
+{
+    assert(old_cfg.is_valid() && new_cfg.is_valid());
+    // Copies of a CFG share their entries.
+    if(old_cfg.begin() == new_cfg.begin() && old_cfg.end() == new_cfg.end())
+    {
+        return 0;
+    }
+
+    size_t changes = 0;
+    size_t a = 0, b = 0;
+    const size_t a_count = old_cfg.section_count();
+    const size_t b_count = new_cfg.section_count();
+    while(a < a_count || b < b_count)
+    {
+        // Section 0 of both is the unnamed section, and then sections are sorted by name.
+        const int order =
+            a == a_count ? 1 : b == b_count ? -1
+                         : compare(old_cfg.section_name(a), new_cfg.section_name(b));
+        // A section missing in one of the CFGs is merged with an empty range.
+        const auto a_begin = order > 0 ? old_cfg.end() : old_cfg.section_begin(a);
+        const auto a_end   = order > 0 ? old_cfg.end() : old_cfg.section_end(a);
+        const auto b_begin = order < 0 ? new_cfg.end() : new_cfg.section_begin(b);
+        const auto b_end   = order < 0 ? new_cfg.end() : new_cfg.section_end(b);
+        const auto section = order > 0 ? new_cfg.section_name(b) : old_cfg.section_name(a);
+        changes += diff_entries(old_cfg, a_begin, a_end, new_cfg, b_begin, b_end, section, visit);
+        a += order <= 0;
+        b += order >= 0;
+    }
+    return changes;
+}
+
+#endif /* end of include guard: CONFIG_DIFF_H_TKWQXZRD */
@@ -0,0 +1,267 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CONFIG_HANDLE_H_JWBRQNYF
+#define CONFIG_HANDLE_H_JWBRQNYF
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+
+/** A reloadable CFG shared by many threads; readers never take locks.
+ *
+ * The current CFG is published through an atomic pointer (RCU style): reload() parses a
+ * new CFG on the side and swaps the pointer, while readers keep using the CFG they have
+ * until they're done with it.
+ *
+ * Old CFGs are freed using hazard pointers. Each reader thread has a Reader with its own
+ * slot (on its own cache line) where it announces the CFG it is using. A read is two
+ * loads of the current pointer and a store to the slot - no locks, no shared counters
+ * that every reader would write to. The writer frees an old CFG once no slot points to
+ * it, so at most one old CFG per reader is ever kept alive.
+ *
+ * Writers (reload(), publish()) are serialized by a mutex; they are expected to be rare.
+ */
+class ConfigHandle
+{
+private:
+    /// Hazard pointer slot of a reader. Aligned so slots of different readers are on
+    /// different cache lines.
+    struct alignas(64) Slot
+    {
+        // The CFG the reader is using, or nullptr.
+        std::atomic<const CFG*> hazard;
+        // Is the slot used by a Reader? Protected by ConfigHandle::mutex.
+        bool used;
+
+        // Before C++17, plain new ignores alignas() beyond 16 bytes.
+        static void* operator new(const size_t size)
+        {
+            void* memory;
+            if(posix_memalign(&memory, 64, size) != 0)
+            {
+                throw std::bad_alloc();
+            }
+            return memory;
+        }
+
+        static void operator delete(void* const memory) { free(memory); }
+    };
+
+    // The current CFG.
+    std::atomic<const CFG*> current;
+
+    // Serializes writers and registration of readers.
+    std::mutex mutex;
+
+    // Slots of readers. Only added to (under mutex), so a Reader's slot never moves.
+    std::vector<std::unique_ptr<Slot>> slots;
+
+    // Replaced CFGs that may still be used by readers. Protected by mutex.
+    std::vector<const CFG*> retired;
+
+    /// Claim a slot for a new Reader.
+    Slot* claim_slot()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(const auto& slot: slots)
+        {
+            if(!slot->used)
+            {
+                slot->used = true;
+                return slot.get();
+            }
+        }
+        slots.emplace_back(new Slot());
+        slots.back()->hazard.store(nullptr);
+        slots.back()->used = true;
+        return slots.back().get();
+    }
+
+    /// Return a slot of a destroyed Reader.
+    void release_slot(Slot* const slot)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(slot->hazard.load() == nullptr);
+        slot->used = false;
+    }
+
+    /// Free retired CFGs that no reader is using. Must be called with mutex locked.
+    void reclaim()
+    {
+        size_t kept = 0;
+        for(const CFG* const cfg: retired)
+        {
+            bool in_use = false;
+            for(const auto& slot: slots)
+            {
+                in_use = in_use || slot->hazard.load(std::memory_order_seq_cst) == cfg;
+            }
+            if(in_use)
+            {
+                retired[kept++] = cfg;
+            }
+            else
+            {
+                delete cfg;
+            }
+        }
+        retired.resize(kept);
+    }
+
+public:
+    /** Reads the current CFG of a ConfigHandle. One per reader thread.
+     *
+     * Not thread-safe itself: each thread must use its own Reader. A thread may hold one
+     * CFG at a time (acquire() releases the previous one).
+     */
+    class Reader
+    {
+    private:
+        ConfigHandle& handle;
+
+        Slot* const slot;
+
+    public:
+        explicit Reader(ConfigHandle& handle)
+            : handle(handle)
+            , slot(handle.claim_slot())
+        {
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        ~Reader()
+        {
+            release();
+            handle.release_slot(slot);
+        }
+
+        /** Get the current CFG.
+         *
+         * The CFG stays valid (even if reloaded meanwhile) until release() or the next
+         * acquire(). Lock-free: only retries if a reload happens right now.
+         */
+        const CFG& acquire()
+        {
+            const CFG* cfg = handle.current.load(std::memory_order_acquire);
+            for(;;)
+            {
+                slot->hazard.store(cfg, std::memory_order_seq_cst);
+                // If it was replaced before we announced it, the writer might not see
+                // our hazard; try again with the new one.
+                const CFG* const check = handle.current.load(std::memory_order_seq_cst);
+                if(check == cfg)
+                {
+                    return *cfg;
+                }
+                cfg = check;
+            }
+        }
+
+        /// Stop using the CFG returned by acquire(), so it can be freed if replaced.
+        void release()
+        {
+            slot->hazard.store(nullptr, std::memory_order_release);
+        }
+    };
+
+    /// Acquires the current CFG of a Reader for the lifetime of the Guard.
+    class Guard
+    {
+    private:
+        Reader& reader;
+
+        const CFG& cfg;
+
+    public:
+        explicit Guard(Reader& reader)
+            : reader(reader)
+            , cfg(reader.acquire())
+        {
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard() { reader.release(); }
+
+        const CFG& operator*() const { return cfg; }
+
+        const CFG* operator->() const { return &cfg; }
+    };
+
+    /// Construct a handle with an initial CFG.
+    explicit ConfigHandle(CFG cfg)
+        : current(new CFG(std::move(cfg)))
+    {
+    }
+
+    ConfigHandle(const ConfigHandle&) = delete;
+    ConfigHandle& operator=(const ConfigHandle&) = delete;
+
+    /// All Readers must be destroyed before the handle.
+    ~ConfigHandle()
+    {
+        for(const auto& slot: slots)
+        {
+            assert(!slot->used);
+        }
+        for(const CFG* const cfg: retired)
+        {
+            delete cfg;
+        }
+        delete current.load();
+    }
+
+    /** Replace the current CFG.
+     *
+     * Readers that acquire()d the old CFG keep using it; it is freed by a later publish()
+     * after they release it.
+     */
+    void publish(CFG cfg)
+    {
+        const CFG* const replacement = new CFG(std::move(cfg));
+        std::lock_guard<std::mutex> lock(mutex);
+        retired.push_back(current.exchange(replacement, std::memory_order_seq_cst));
+        reclaim();
+    }
+
+    /** Parse a file and publish() it. Parsing is done before taking any locks.
+     *
+     * Parameters are the same as in CFG::CFG().
+     *
+     * Returns false (and keeps the current CFG) if the file can't be loaded or parsed.
+     */
+    bool reload(const std::string& filename, const Loader loader = Loader::IFSTREAM,
+                const unsigned threads = 1)
+    {
+        CFG cfg(filename, loader, threads);
+        if(!cfg.is_valid())
+        {
+            return false;
+        }
+        publish(std::move(cfg));
+        return true;
+    }
+
+    /// Number of replaced CFGs not freed yet (because readers might still use them).
+    size_t retired_count()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return retired.size();
+    }
+};
+
+#endif /* end of include guard: CONFIG_HANDLE_H_JWBRQNYF */
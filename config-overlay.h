@@ -0,0 +1,290 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef CONFIG_OVERLAY_H_BNMVXLQE
+#define CONFIG_OVERLAY_H_BNMVXLQE
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cfg5-noalloc.h"
+
+/** A view of several CFGs stacked on top of each other, e.g. defaults, then
+ * environment-specific, then host-specific overrides.
+ *
+ * A key in a higher layer overrides the same key (in the same section) in lower layers.
+ * Layers are not copied or merged: find() asks the layers from the top down and
+ * iteration merges their sorted entries on the fly (a k-way merge), so neither allocates
+ * anything. Once the layers stop changing, flatten() merges them into a single CFG.
+ *
+ * The overlay only points to its layers; they must outlive it.
+ */
+class ConfigOverlay
+{
+public:
+    /// Maximum number of layers. The overlay and its iterators have fixed-size arrays of
+    /// layers, so they don't allocate.
+    static const size_t MAX_LAYERS = 16;
+
+    /// An entry of an overlay: the entry and the layer it's from.
+    struct OverlayEntry
+    {
+        // The layer containing entry; nullptr if not found.
+        const CFG* layer;
+        const Entry* entry;
+        // Name of the section of entry; empty for the unnamed section.
+        Slice<const char> section;
+
+        Slice<const char> key() const { return layer->key(*entry); }
+
+        Slice<const char> value() const { return layer->value(*entry); }
+
+        /// Was the entry found?
+        bool found() const { return layer != nullptr; }
+    };
+
+private:
+    // Layers from the bottom (lowest priority) to the top.
+    const CFG* layers[MAX_LAYERS];
+
+    size_t count = 0;
+
+public:
+    /** Iterates over entries of all layers, sorted by section and key like a CFG.
+     *
+     * A key in several layers is visited once, with the entry of the highest layer.
+     */
+    class const_iterator
+    {
+    private:
+        const ConfigOverlay* overlay;
+
+        // The next not yet visited entry of each layer and the section it's in. Entries
+        // of a layer are at its end() once it's exhausted.
+        CFG::const_iterator next[MAX_LAYERS];
+        size_t section[MAX_LAYERS];
+
+        // The layer of the current entry (its next[] entry), or MAX_LAYERS at the end.
+        size_t current;
+
+        // Bit l is set if next[l] has the same section and key as the current entry.
+        uint32_t current_layers;
+
+        /// Skip to the section of next[l] (past any empty sections).
+        void skip_sections(const size_t l)
+        {
+            const CFG& layer = *overlay->layers[l];
+            while(section[l] < layer.section_count() && next[l] == layer.section_end(section[l]))
+            {
+                ++section[l];
+            }
+        }
+
+        /// Compare next entries of two layers by section, then key.
+        int compare_next(const size_t a, const size_t b) const
+        {
+            const CFG& layer_a = *overlay->layers[a];
+            const CFG& layer_b = *overlay->layers[b];
+            // Most configs only have the unnamed section; no need to compare its name.
+            if(section[a] != 0 || section[b] != 0)
+            {
+                const int order = compare(layer_a.section_name(section[a]),
+                                          layer_b.section_name(section[b]));
+                if(order != 0)
+                {
+                    return order;
+                }
+            }
+            return compare_keys(layer_a, *next[a], layer_b, *next[b]);
+        }
+
+        /// Find the current entry: the smallest next entry, from the highest layer.
+        void find_current()
+        {
+            current        = MAX_LAYERS;
+            current_layers = 0;
+            for(size_t l = overlay->count; l-- > 0;)
+            {
+                if(next[l] == overlay->layers[l]->end())
+                {
+                    continue;
+                }
+                const int order = current == MAX_LAYERS ? -1 : compare_next(l, current);
+                if(order < 0)
+                {
+                    current        = l;
+                    current_layers = 1u << l;
+                }
+                else if(order == 0)
+                {
+                    current_layers |= 1u << l;
+                }
+            }
+        }
+
+    public:
+        /// Construct an iterator at the start (or end) of an overlay.
+        const_iterator(const ConfigOverlay& overlay, const bool at_end)
+            : overlay(&overlay)
+            , current(MAX_LAYERS)
+            , current_layers(0)
+        {
+            if(at_end)
+            {
+                return;
+            }
+            for(size_t l = 0; l < overlay.count; ++l)
+            {
+                next[l]    = overlay.layers[l]->begin();
+                section[l] = 0;
+                skip_sections(l);
+            }
+            find_current();
+        }
+
+        OverlayEntry operator*() const
+        {
+            assert(current != MAX_LAYERS);
+            const CFG& layer = *overlay->layers[current];
+            return OverlayEntry{&layer, next[current], layer.section_name(section[current])};
+        }
+
+        /// Move to the next key, skipping entries with the current key in lower layers.
+        const_iterator& operator++()
+        {
+            assert(current != MAX_LAYERS);
+            for(size_t l = 0; l < overlay->count; ++l)
+            {
+                if(current_layers & (1u << l))
+                {
+                    ++next[l];
+                    skip_sections(l);
+                }
+            }
+            find_current();
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator old(*this);
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            return current == rhs.current &&
+                   (current == MAX_LAYERS || next[current] == rhs.next[current]);
+        }
+
+        bool operator!=(const const_iterator& rhs) const { return !(*this == rhs); }
+    };
+
+    ConfigOverlay() {}
+
+    /** Add a layer on top of the current layers: its keys override theirs.
+     *
+     * layer = A valid CFG. Not copied; must outlive the overlay.
+     */
+    void push(const CFG& layer)
+    {
+        assert(count < MAX_LAYERS && "too many layers");
+        assert(layer.is_valid());
+        layers[count++] = &layer;
+    }
+
+    /// Number of layers.
+    size_t layer_count() const { return count; }
+
+    /// Get layer l; layer 0 is the bottom one.
+    const CFG& layer(const size_t l) const
+    {
+        assert(l < count);
+        return *layers[l];
+    }
+
+    /** Find a key in the unnamed section of the highest layer that has it.
+     *
+     * Uses the indices of the layers, if built. Returns an entry that is not found() if
+     * no layer has the key.
+     */
+    OverlayEntry find(const Slice<const char> key) const
+    {
+        for(size_t l = count; l-- > 0;)
+        {
+            const auto found = layers[l]->find(key);
+            if(found != layers[l]->end())
+            {
+                return OverlayEntry{layers[l], found, Slice<const char>(nullptr, 0)};
+            }
+        }
+        return OverlayEntry{nullptr, nullptr, Slice<const char>(nullptr, 0)};
+    }
+
+    /// Find a key in a section of the highest layer that has it. See find(key).
+    ///
+    /// The section of the result is the section argument.
+    OverlayEntry find(const Slice<const char> section, const Slice<const char> key) const
+    {
+        for(size_t l = count; l-- > 0;)
+        {
+            const auto found = layers[l]->find(section, key);
+            if(found != layers[l]->end())
+            {
+                return OverlayEntry{layers[l], found, section};
+            }
+        }
+        return OverlayEntry{nullptr, nullptr, Slice<const char>(nullptr, 0)};
+    }
+
+    OverlayEntry find(const char* const key) const
+    {
+        return find(Slice<const char>(key, strlen(key)));
+    }
+
+    OverlayEntry find(const char* const section, const char* const key) const
+    {
+        return find(Slice<const char>(section, strlen(section)),
+                    Slice<const char>(key, strlen(key)));
+    }
+
+    const_iterator begin() const { return const_iterator(*this, false); }
+
+    const_iterator end() const { return const_iterator(*this, true); }
+
+    /** Merge the layers into a single CFG with a frozen index (see CFG::freeze()).
+     *
+     * For when the layers won't change anymore: find() then needs one lookup instead of
+     * one per layer. The result has its own copy of keys and values and doesn't need the
+     * layers.
+     */
+    CFG flatten() const
+    {
+        auto entry = begin();
+        const auto last = end();
+        CFG result = CFG::from_sorted(
+            [&](Slice<const char>& section, Slice<const char>& key, Slice<const char>& value) {
+            if(entry == last)
+            {
+                return false;
+            }
+            const OverlayEntry e = *entry++;
+            section = e.section;
+            key     = e.key();
+            value   = e.value();
+            return true;
+        });
+        if(result.is_valid())
+        {
+            result.freeze();
+        }
+        return result;
+    }
+};
+
+#endif /* end of include guard: CONFIG_OVERLAY_H_BNMVXLQE */
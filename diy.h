@@ -3,50 +3,780 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
-#include <time.h> 
+#ifndef DIY_H_QHXWMZRA
+#define DIY_H_QHXWMZRA
+
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "spsc-ring.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define DIY_HAS_TSC 1
+#else
+#define DIY_HAS_TSC 0
+#endif
 
 // POSIX ONLY! For portability add a Windows get_nsecs() implementation and use #ifdef
 
-/// Gets current time in nanoseconds
-uint64_t get_nsecs()
+/// Get time of a clock in nanoseconds. Returns 0 if the clock can't be read.
+inline uint64_t clock_nsecs(const clockid_t clock)
 {
     timespec ts;
     // If this fails, we can't profile on this machine
-    if(clock_gettime(CLOCK_REALTIME, &ts) != 0)
+    if(clock_gettime(clock, &ts) != 0)
     {
         return 0;
     }
 
-    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/// Gets current time in nanoseconds
+///
+/// Monotonic: unlike CLOCK_REALTIME, it doesn't jump when the system time is adjusted.
+inline uint64_t get_nsecs()
+{
+    return clock_nsecs(CLOCK_MONOTONIC);
+}
+
+/** Clocks that Zones can measure time with.
+ *
+ * clock_gettime() goes through the vDSO (and on some VMs a syscall) on every call; in hot
+ * loops that can cost more than the code being measured. Reading the CPU's time stamp
+ * counter is a single instruction, but its ticks must be converted to nanoseconds (see
+ * calibrate_tsc()) and it can only be trusted if it is invariant: ticking at a constant
+ * rate in all power states, and in sync on all cores.
+ */
+enum class ZoneClock
+{
+    /// clock_gettime(CLOCK_MONOTONIC).
+    MONOTONIC,
+    /// rdtsc: the cheapest, but the CPU may execute it before preceding instructions
+    /// finish (or after following ones start).
+    RDTSC,
+    /// rdtscp: waits for preceding instructions to finish; a bit slower than rdtsc.
+    RDTSCP
+};
+
+/// The clock used by Zones and how to convert its ticks to nanoseconds.
+struct ZoneClockState
+{
+    ZoneClock clock;
+    // Nanoseconds per tick of the TSC, from calibrate_tsc().
+    double nsecs_per_tick;
+    // TSC and CLOCK_MONOTONIC times taken together at calibration. TSC ticks are
+    // converted to CLOCK_MONOTONIC nanoseconds, so all clocks have the same time base.
+    uint64_t tick_base;
+    uint64_t nsecs_base;
+    // Has the clock been chosen by set_zone_clock()?
+    bool chosen;
+};
+
+/// Does the CPU have an invariant TSC (a constant rate, not stopped in sleep states)?
+inline bool has_invariant_tsc()
+{
+#if DIY_HAS_TSC
+    unsigned eax, ebx, ecx, edx;
+    // CPUID leaf 0x80000007 (advanced power management), EDX bit 8.
+    if(!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007 ||
+       !__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+#if DIY_HAS_TSC
+/** Read the TSC and a clock at the same time (as far as possible).
+ *
+ * The clock read is bracketed by two TSC reads. An interrupt or a VM exit between them
+ * would skew the pair, so we take the tightest of several tries.
+ */
+inline void read_tsc_and_clock(const clockid_t clock, uint64_t& tsc, uint64_t& nsecs)
+{
+    tsc = nsecs = 0;
+    uint64_t tightest = UINT64_MAX;
+    for(unsigned i = 0; i < 16; ++i)
+    {
+        const uint64_t before = __rdtsc();
+        const uint64_t clock_nsec = clock_nsecs(clock);
+        const uint64_t after  = __rdtsc();
+        if(after - before < tightest)
+        {
+            tightest = after - before;
+            tsc      = before + (after - before) / 2;
+            nsecs    = clock_nsec;
+        }
+    }
+}
+#endif
+
+/** Measure the TSC rate against CLOCK_MONOTONIC_RAW (which is not slewed by NTP).
+ *
+ * Busy waits for about 10 ms. Returns the state of the RDTSC clock, or of the MONOTONIC
+ * clock if there is no TSC.
+ */
+inline ZoneClockState calibrate_tsc()
+{
+    ZoneClockState state{ZoneClock::MONOTONIC, 1.0, 0, 0, false};
+#if DIY_HAS_TSC
+    uint64_t tsc_start, nsec_start, tsc_end, nsec_end;
+    read_tsc_and_clock(CLOCK_MONOTONIC_RAW, tsc_start, nsec_start);
+    while(clock_nsecs(CLOCK_MONOTONIC_RAW) - nsec_start < 10000000) {}
+    read_tsc_and_clock(CLOCK_MONOTONIC_RAW, tsc_end, nsec_end);
+    if(tsc_end <= tsc_start)
+    {
+        return state;
+    }
+
+    state.clock          = ZoneClock::RDTSC;
+    state.nsecs_per_tick = static_cast<double>(nsec_end - nsec_start) / (tsc_end - tsc_start);
+    read_tsc_and_clock(CLOCK_MONOTONIC, state.tick_base, state.nsecs_base);
+#endif
+    return state;
+}
+
+/// The best clock of this machine: TSC if invariant, CLOCK_MONOTONIC otherwise.
+inline ZoneClock default_zone_clock()
+{
+    return has_invariant_tsc() ? ZoneClock::RDTSC : ZoneClock::MONOTONIC;
+}
+
+/** The clock used by Zones; one for the whole program.
+ *
+ * CLOCK_MONOTONIC until set_zone_clock() is called or a ZoneCollector starts, so programs
+ * that don't record zones never calibrate the TSC. Constant-initialized: no guard on reads.
+ */
+inline ZoneClockState& zone_clock()
+{
+    static ZoneClockState state{ZoneClock::MONOTONIC, 1.0, 0, 0, false};
+    return state;
+}
+
+/// The TSC calibration, done by the first call (which busy waits; see calibrate_tsc()).
+inline const ZoneClockState& tsc_calibration()
+{
+    static const ZoneClockState state = calibrate_tsc();
+    return state;
+}
+
+/** Change the clock used by Zones.
+ *
+ * Don't call while any Zones are alive: their start and end would be from different
+ * clocks.
+ *
+ * clock = The clock to use. If a TSC clock is requested and there is no TSC, or it is
+ *         not invariant and force is false, CLOCK_MONOTONIC is used.
+ * force = Use the TSC even if it's not invariant. Times may then be wrong if the CPU
+ *         changes frequency or the thread moves to another core.
+ *
+ * Returns the clock actually used.
+ */
+inline ZoneClock set_zone_clock(const ZoneClock clock, const bool force = false)
+{
+    ZoneClockState& state = zone_clock();
+    if(clock == ZoneClock::MONOTONIC || !(force || has_invariant_tsc()) ||
+       tsc_calibration().clock == ZoneClock::MONOTONIC)
+    {
+        state.clock = ZoneClock::MONOTONIC;
+    }
+    else
+    {
+        state       = tsc_calibration();
+        state.clock = clock;
+    }
+    state.chosen = true;
+    return state.clock;
+}
+
+/// Use default_zone_clock() for Zones unless set_zone_clock() chose a clock already.
+inline void use_default_zone_clock()
+{
+    if(!zone_clock().chosen)
+    {
+        set_zone_clock(default_zone_clock());
+    }
+}
+
+/// Current time of the Zone clock, in ticks. Convert with ticks_to_nsecs().
+inline uint64_t zone_ticks()
+{
+#if DIY_HAS_TSC
+    // Always the same clock in a measurement, so the branch is predicted.
+    const ZoneClock clock = zone_clock().clock;
+    if(clock == ZoneClock::RDTSC)
+    {
+        return __rdtsc();
+    }
+    if(clock == ZoneClock::RDTSCP)
+    {
+        unsigned aux;
+        return __rdtscp(&aux);
+    }
+#endif
+    return get_nsecs();
+}
+
+/// Convert ticks of the Zone clock to CLOCK_MONOTONIC nanoseconds.
+inline uint64_t ticks_to_nsecs(const uint64_t ticks)
+{
+    const ZoneClockState& state = zone_clock();
+    if(state.clock == ZoneClock::MONOTONIC)
+    {
+        return ticks;
+    }
+    const int64_t ticks_since_base = static_cast<int64_t>(ticks - state.tick_base);
+    return state.nsecs_base + static_cast<int64_t>(ticks_since_base * state.nsecs_per_tick);
+}
+
+/// ID of a zone name; see zone_id().
+typedef uint32_t ZoneId;
+
+/// Zone names and their IDs.
+struct ZoneNames
+{
+    /// Maximum number of distinct zone names. Any more names all get ID 0.
+    static const size_t MAX_NAMES = 1024;
+
+    // Lock-free lookup of IDs by name pointer: an open addressing table whose slots are
+    // filled (under mutex) but never changed or emptied.
+    static const size_t SLOTS = 4 * MAX_NAMES;
+    std::atomic<const char*> slot_names[SLOTS];
+    // ID of the name in a slot. Written before the name is stored to slot_names.
+    ZoneId slot_ids[SLOTS];
+
+    // Names by ID. A name is written before its ID is published.
+    const char* names[MAX_NAMES];
+    uint32_t count;
+
+    // Serializes adding names.
+    std::mutex mutex;
+    // IDs by name, so equal names at different addresses get the same ID.
+    std::unordered_map<std::string, ZoneId> ids;
+
+    ZoneNames()
+        : count(1)
+    {
+        for(auto& name: slot_names)
+        {
+            name.store(nullptr, std::memory_order_relaxed);
+        }
+        names[0] = "(too many zone names)";
+    }
+
+    /// First slot to look for a name pointer at.
+    static size_t first_slot(const char* const name)
+    {
+        const uint64_t address = reinterpret_cast<uintptr_t>(name);
+        return static_cast<size_t>((address * 0x9E3779B97F4A7C15ULL) >> 32) % SLOTS;
+    }
+
+    /// Add a name not found by zone_id().
+    ZoneId add(const char* const name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t slot = first_slot(name);
+        for(size_t probe = 0; probe < SLOTS; ++probe, slot = (slot + 1) % SLOTS)
+        {
+            const char* const in_slot = slot_names[slot].load(std::memory_order_relaxed);
+            if(in_slot == name)
+            {
+                // Added by another thread meanwhile.
+                return slot_ids[slot];
+            }
+            if(in_slot != nullptr)
+            {
+                continue;
+            }
+            const auto found = ids.find(name);
+            ZoneId id = 0;
+            if(found != ids.end())
+            {
+                id = found->second;
+            }
+            else if(count < MAX_NAMES)
+            {
+                id = count;
+                names[count++] = name;
+                ids[name] = id;
+            }
+            slot_ids[slot] = id;
+            slot_names[slot].store(name, std::memory_order_release);
+            return id;
+        }
+        return 0;
+    }
+};
+
+/// Zone names of the whole program (not one table per translation unit).
+inline ZoneNames& zone_names()
+{
+    static ZoneNames names;
+    return names;
+}
+
+/** Get the ID of a zone name.
+ *
+ * name must live as long as the program (e.g. a string literal). Lock-free after the
+ * first call with the same name pointer (a hash table probe); the first call locks.
+ */
+inline ZoneId zone_id(const char* const name)
+{
+    ZoneNames& names = zone_names();
+    size_t slot = ZoneNames::first_slot(name);
+    for(size_t probe = 0; probe < ZoneNames::SLOTS; ++probe)
+    {
+        const char* const in_slot = names.slot_names[slot].load(std::memory_order_acquire);
+        if(in_slot == name)
+        {
+            return names.slot_ids[slot];
+        }
+        if(in_slot == nullptr)
+        {
+            break;
+        }
+        slot = (slot + 1) % ZoneNames::SLOTS;
+    }
+    return names.add(name);
+}
+
+/// Get the name of a zone ID returned by zone_id().
+inline const char* zone_name(const ZoneId id)
+{
+    const ZoneNames& names = zone_names();
+    return id < ZoneNames::MAX_NAMES ? names.names[id] : names.names[0];
+}
+
+/** Hash of the call path of a zone: IDs of the zones it is in, and its own ID.
+ *
+ * parent = Call path hash of the zone the zone is in; 0 if it's not in any zone.
+ * id     = ID of the zone.
+ */
+inline uint64_t zone_path(const uint64_t parent, const ZoneId id)
+{
+    const uint64_t hash = (parent ^ (id + 1ULL)) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+/// A finished zone, as recorded by a thread. See ZoneCollector.
+struct ZoneRecord
+{
+    // Start and end in ticks of the Zone clock; see ticks_to_nsecs().
+    uint64_t start;
+    uint64_t end;
+    // Call path hash of the zone this zone was in (0 if none); see zone_path().
+    uint64_t parent_path;
+    ZoneId zone;
+    // Number of zones the zone was in (0 if it was not in any zone).
+    uint32_t depth;
+};
+
+/// Capacity of the zone record buffer of each thread. 512 kiB of ZoneRecords.
+const size_t ZONE_BUFFER_RECORDS = 1 << 14;
+
+/// Records of zones finished by one thread, until a ZoneCollector takes them.
+struct ZoneBuffer
+{
+    SpscRing<ZoneRecord, ZONE_BUFFER_RECORDS> records;
+    // Records dropped because the buffer was full. Written only by the thread.
+    std::atomic<uint64_t> overflows;
+    // Set when the thread exits. The buffer is then freed by the collector once drained.
+    std::atomic<bool> exited;
+    // Index of the thread, in the order threads recorded their first zones.
+    uint32_t thread;
+
+    explicit ZoneBuffer(const uint32_t thread)
+        : overflows(0)
+        , exited(false)
+        , thread(thread)
+    {
+    }
+};
+
+/// Is a ZoneCollector running? Zones are only recorded while one is.
+///
+/// Constant-initialized, so checking it in each Zone costs no initialization guard.
+inline std::atomic<bool>& zone_recording()
+{
+    static std::atomic<bool> recording(false);
+    return recording;
+}
+
+/// Buffers of all threads that recorded zones.
+struct ZoneThreads
+{
+    // Protects everything below.
+    std::mutex mutex;
+    // Buffers of threads that recorded zones.
+    std::vector<ZoneBuffer*> buffers;
+    // Number of threads that recorded zones so far.
+    uint32_t thread_count;
+    // Overflows of buffers freed after their threads exited.
+    uint64_t freed_overflows;
+
+    ZoneThreads()
+        : thread_count(0)
+        , freed_overflows(0)
+    {
+    }
+
+    ~ZoneThreads()
+    {
+        for(ZoneBuffer* const buffer: buffers)
+        {
+            delete buffer;
+        }
+    }
+
+    /// Total number of records dropped by all threads so far.
+    uint64_t overflows()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t total = freed_overflows;
+        for(const ZoneBuffer* const buffer: buffers)
+        {
+            total += buffer->overflows.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+/// Zone buffers of the whole program (not one registry per translation unit).
+inline ZoneThreads& zone_threads()
+{
+    static ZoneThreads threads;
+    return threads;
+}
+
+/// Zone state of one thread.
+struct ZoneThreadState
+{
+    // Zone record buffer of the thread. Created when the thread records its first zone.
+    ZoneBuffer* buffer;
+    // Set when the thread is exiting; zones in destructors of thread_locals are not
+    // recorded.
+    bool exited;
+    // The zone stack of the thread. Only its top is stored here: each Zone saves the
+    // depth and path of its parent and restores them when it ends.
+
+    // Number of Zones the thread is in.
+    uint32_t depth;
+    // Call path hash of the innermost Zone the thread is in (0 if none).
+    uint64_t current_path;
+};
+
+/// Zone state of this thread; one per thread in the whole program. Constant-initialized.
+inline ZoneThreadState& zone_thread()
+{
+    static thread_local ZoneThreadState state{nullptr, false, 0, 0};
+    return state;
+}
+
+/// Push a zone to the zone stack of this thread. Returns the path of its parent.
+inline uint64_t enter_zone(const ZoneId id)
+{
+    ZoneThreadState& thread = zone_thread();
+    const uint64_t parent   = thread.current_path;
+    thread.current_path     = zone_path(parent, id);
+    ++thread.depth;
+    return parent;
 }
 
+/// Marks the zone buffer of a thread as exited when the thread exits.
+struct ZoneThreadExit
+{
+    ~ZoneThreadExit()
+    {
+        ZoneThreadState& thread = zone_thread();
+        thread.exited = true;
+        if(thread.buffer != nullptr)
+        {
+            thread.buffer->exited.store(true, std::memory_order_release);
+            thread.buffer = nullptr;
+        }
+    }
+};
+
+/// Create the zone buffer of this thread. Returns nullptr if the thread is exiting.
+inline ZoneBuffer* add_zone_buffer()
+{
+    ZoneThreadState& thread = zone_thread();
+    if(thread.exited)
+    {
+        return nullptr;
+    }
+    // Constructed here, on first use, so its destructor runs on thread exit.
+    static thread_local ZoneThreadExit exit;
+    (void)&exit;
+    ZoneThreads& threads = zone_threads();
+    std::lock_guard<std::mutex> lock(threads.mutex);
+    thread.buffer = new ZoneBuffer(threads.thread_count++);
+    threads.buffers.push_back(thread.buffer);
+    return thread.buffer;
+}
+
+/// Record a finished zone in the buffer of this thread. Never blocks (except the first
+/// time a thread records a zone); if the buffer is full, the record is dropped and counted.
+inline void record_zone(const ZoneRecord& record)
+{
+    ZoneBuffer* buffer = zone_thread().buffer;
+    if(buffer == nullptr && (buffer = add_zone_buffer()) == nullptr)
+    {
+        return;
+    }
+    if(!buffer->records.push(record))
+    {
+        // Only this thread writes the counter, so no atomic increment needed.
+        buffer->overflows.store(buffer->overflows.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+    }
+}
+
+/** Takes zone records from the buffers of all threads on a background thread.
+ *
+ * Zones are recorded only while a ZoneCollector exists (at most one at a time). Each
+ * thread pushes records of its finished zones to its own ring buffer (SpscRing); the
+ * collector thread periodically drains all buffers and passes the records to a sink.
+ * Instrumented threads never wait for the collector: if a buffer is full, records are
+ * dropped and counted (see overflows()), so keep the period short enough for the buffer
+ * (ZONE_BUFFER_RECORDS) to hold all zones finished in one period.
+ *
+ * The sink runs on the collector thread and gets records of one thread at a time, in the
+ * order the zones ended (so nested zones come before the zones they are in).
+ */
+class ZoneCollector
+{
+public:
+    /// Called with records of a thread; records are only valid during the call.
+    typedef std::function<void(uint32_t thread, const ZoneRecord* records, size_t count)>
+        Sink;
+
+private:
+    Sink sink;
+
+    const std::chrono::microseconds period;
+
+    // Overflows of all threads when the collector started.
+    const uint64_t start_overflows;
+
+    std::atomic<bool> stopping;
+
+    std::atomic<uint64_t> collected_;
+
+    // Buffers being drained; a copy so threads can add buffers while we drain.
+    std::vector<ZoneBuffer*> draining;
+
+    // Buffers of exited threads that have been drained.
+    std::vector<ZoneBuffer*> exited;
+
+    std::thread thread;
+
+    /// Drain all buffers once; free buffers of exited threads.
+    void collect()
+    {
+        ZoneThreads& threads = zone_threads();
+        {
+            std::lock_guard<std::mutex> lock(threads.mutex);
+            draining.assign(threads.buffers.begin(), threads.buffers.end());
+        }
+        uint64_t count = 0;
+        for(ZoneBuffer* const buffer: draining)
+        {
+            // Read before draining: if the thread has exited, we drain everything it
+            // has recorded.
+            const bool thread_exited = buffer->exited.load(std::memory_order_acquire);
+            count += buffer->records.drain([&](const ZoneRecord* records, size_t n)
+            {
+                sink(buffer->thread, records, n);
+            });
+            if(thread_exited)
+            {
+                exited.push_back(buffer);
+            }
+        }
+        collected_.store(collected_.load(std::memory_order_relaxed) + count,
+                         std::memory_order_relaxed);
+        if(exited.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        auto& buffers = threads.buffers;
+        for(ZoneBuffer* const buffer: exited)
+        {
+            threads.freed_overflows += buffer->overflows.load(std::memory_order_relaxed);
+            buffers.erase(std::find(buffers.begin(), buffers.end(), buffer));
+            delete buffer;
+        }
+        exited.clear();
+    }
+
+    /// Drop records left in buffers by Zones that ended as a previous collector stopped.
+    static void discard_stale()
+    {
+        ZoneThreads& threads = zone_threads();
+        std::lock_guard<std::mutex> lock(threads.mutex);
+        for(ZoneBuffer* const buffer: threads.buffers)
+        {
+            buffer->records.drain([](const ZoneRecord*, size_t) {});
+        }
+    }
+
+    /// Collector thread loop.
+    void run()
+    {
+        while(!stopping.load(std::memory_order_acquire))
+        {
+            collect();
+            std::this_thread::sleep_for(period);
+        }
+        collect();
+    }
+
+public:
+    /** Start recording zones and collecting them.
+     *
+     * Switches Zones to default_zone_clock() unless set_zone_clock() was called, so
+     * don't start a collector while any Zones are alive.
+     *
+     * sink         = Called with collected records, on the collector thread.
+     * period_usecs = How often to drain buffers of threads, in microseconds.
+     */
+    explicit ZoneCollector(Sink sink, const unsigned period_usecs = 1000)
+        : sink(std::move(sink))
+        , period(period_usecs)
+        , start_overflows(zone_threads().overflows())
+        , stopping(false)
+        , collected_(0)
+    {
+        use_default_zone_clock();
+        discard_stale();
+        const bool already_recording = zone_recording().exchange(true);
+        assert(!already_recording && "Only one ZoneCollector may exist at a time");
+        (void)already_recording;
+        thread = std::thread(&ZoneCollector::run, this);
+    }
+
+    ZoneCollector(const ZoneCollector&) = delete;
+    ZoneCollector& operator=(const ZoneCollector&) = delete;
+
+    ~ZoneCollector() { stop(); }
+
+    /// Stop recording zones, collect the remaining records and stop the collector thread.
+    void stop()
+    {
+        if(!thread.joinable())
+        {
+            return;
+        }
+        zone_recording().store(false, std::memory_order_release);
+        stopping.store(true, std::memory_order_release);
+        thread.join();
+        // A Zone that saw recording just before it was cleared may have pushed its record
+        // after the last collect() of the collector thread.
+        collect();
+    }
+
+    /// Number of records passed to the sink so far.
+    uint64_t collected() const { return collected_.load(std::memory_order_relaxed); }
+
+    /// Number of records dropped (by all threads) since the collector started.
+    uint64_t overflows() const { return zone_threads().overflows() - start_overflows; }
+};
+
 /// Set to true to print zone times
+///
+/// The simplest way to see zone times, but printing costs far more than most zones
+/// measure and is not thread-safe. Use a ZoneCollector to record zones instead.
 static bool PRINT_ZONES = false;
 
 /// Measures time spent between its constructor and destructor.
+///
+/// While a ZoneCollector exists, a ZoneRecord of the zone is recorded in the destructor.
 class Zone
 {
 private:
-    const uint64_t start;
+    const ZoneId id;
+
+    // Depth and call path hash of the parent zone.
+    const uint32_t depth;
+    const uint64_t parent_path;
 
-    const char* const name;
+    const uint64_t start;
 
 public:
-    Zone(const char* const name)
-        : start(get_nsecs())
-        , name(name)
+    /// name must live as long as the program (e.g. a string literal); see zone_id().
+    explicit Zone(const char* const name)
+        : Zone(zone_id(name))
     {}
 
+    explicit Zone(const ZoneId id)
+        : id(id)
+        , depth(zone_thread().depth)
+        , parent_path(enter_zone(id))
+        , start(zone_ticks())
+    {}
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
     ~Zone()
     {
-        const uint64_t end = get_nsecs();
-        const uint64_t dur = end - start;
+        const uint64_t end      = zone_ticks();
+        ZoneThreadState& thread = zone_thread();
+        thread.depth            = depth;
+        thread.current_path     = parent_path;
+        if(zone_recording().load(std::memory_order_acquire))
+        {
+            record_zone(ZoneRecord{start, end, parent_path, id, depth});
+        }
         if(PRINT_ZONES)
         {
-            std::cout << "Zone '" << name << "':\n" 
-                << "\t" << dur << " ns from " << start << " to " << end << "\n";
+            const uint64_t start_ns = ticks_to_nsecs(start);
+            const uint64_t end_ns   = ticks_to_nsecs(end);
+            std::cout << "Zone '" << zone_name(id) << "':\n"
+                << "\t" << end_ns - start_ns << " ns from " << start_ns << " to " << end_ns
+                << "\n";
         }
     }
 };
+
+/// Zone ID of Frames.
+inline ZoneId frame_zone_id()
+{
+    static const ZoneId id = zone_id("frame");
+    return id;
+}
+
+/** Marks a frame: an iteration of the main loop of a program (e.g. a frame of a game).
+ *
+ * A Zone with a special ID, so frames are recorded like other zones. FrameCapture splits
+ * the zones of a thread into frames by them.
+ */
+class Frame : public Zone
+{
+public:
+    Frame()
+        : Zone(frame_zone_id())
+    {}
+};
+
+#endif /* end of include guard: DIY_H_QHXWMZRA */
@@ -0,0 +1,166 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef EYTZINGER_H_OCNJMXQB
+#define EYTZINGER_H_OCNJMXQB
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Sorted keys in Eytzinger (BFS) order, for cache-friendly branchless binary search.
+ *
+ * A plain binary search jumps all over the array and its branches are unpredictable.
+ * In Eytzinger order, node i has children 2i and 2i + 1: the first levels of the tree
+ * (which every search visits) share a few cache lines, and we know where the search goes
+ * next before deciding which way to go, so we can prefetch. Nodes are 16 bytes and the
+ * array is cache line aligned, so the 4 grandchildren of node i (4i to 4i + 3) share a
+ * cache line; we prefetch it while comparing with node i.
+ *
+ * Each node stores an 8-byte key prefix, so most comparisons are a single integer
+ * comparison; only when prefixes are equal do we need to compare whole keys.
+ */
+
+
+/** Get the first 8 bytes of a key as a big-endian integer, padded with zeroes.
+ *
+ * If prefix(a) < prefix(b) then a < b (in memcmp() order, shorter first if equal). If
+ * prefixes are equal, the keys must be compared in full.
+ */
+inline uint64_t key_prefix(const char* const data, const size_t size)
+{
+    uint64_t prefix = 0;
+    for(size_t i = 0; i < 8; ++i)
+    {
+        prefix <<= 8;
+        prefix |= i < size ? static_cast<uint8_t>(data[i]) : 0;
+    }
+    return prefix;
+}
+
+class EytzingerIndex
+{
+private:
+    struct Node
+    {
+        uint64_t prefix;
+        uint32_t index;
+        uint32_t padding;
+    };
+
+    // Nodes, 1-based, in Eytzinger order. Allocated with extra space for alignment; use
+    // nodes() to get the aligned array.
+    std::vector<Node> storage;
+
+    size_t count = 0;
+
+    /// Get the cache line aligned array of nodes (element 0 is unused).
+    const Node* nodes() const
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(storage.data());
+        return reinterpret_cast<const Node*>((address + 63) & ~uintptr_t(63));
+    }
+
+    Node* nodes_mutable()
+    {
+        return const_cast<Node*>(nodes());
+    }
+
+    /// Fill the subtree at node i with sorted keys starting at k; return next k.
+    template<typename PrefixOf>
+    size_t fill(const size_t i, size_t k, const PrefixOf& prefix_of)
+    {
+        if(i > count)
+        {
+            return k;
+        }
+        k = fill(2 * i, k, prefix_of);
+        Node& node = nodes_mutable()[i];
+        node.prefix  = prefix_of(k);
+        node.index   = static_cast<uint32_t>(k);
+        node.padding = 0;
+        return fill(2 * i + 1, k + 1, prefix_of);
+    }
+
+public:
+    /// Returned by lower_bound() if all keys are less than the searched key.
+    static const uint32_t NOT_FOUND = UINT32_MAX;
+
+    EytzingerIndex() {}
+
+    /// A copy of storage may be aligned differently, so nodes are copied to the aligned
+    /// array of the copy, not just to the same indices of storage.
+    EytzingerIndex(const EytzingerIndex& other)
+        : storage(other.storage.size())
+        , count(other.count)
+    {
+        if(!other.empty())
+        {
+            std::copy(other.nodes(), other.nodes() + count + 1, nodes_mutable());
+        }
+    }
+
+    // Moving keeps the same storage, so it stays aligned.
+    EytzingerIndex(EytzingerIndex&& other) = default;
+    EytzingerIndex& operator=(EytzingerIndex&& other) = default;
+
+    EytzingerIndex& operator=(const EytzingerIndex& other)
+    {
+        EytzingerIndex copy(other);
+        return *this = std::move(copy);
+    }
+
+    /** Build the index.
+     *
+     * count     = Number of keys.
+     * prefix_of = prefix_of(i) must return key_prefix() of sorted key i.
+     */
+    template<typename PrefixOf>
+    void build(const size_t count, const PrefixOf& prefix_of)
+    {
+        this->count = count;
+        // + 1 for unused element 0, + 4 for alignment.
+        storage.assign(count + 1 + 4, Node());
+        fill(1, 0, prefix_of);
+    }
+
+    /// Has the index been built?
+    bool empty() const { return storage.empty(); }
+
+    /// Size of the index in bytes.
+    size_t bytes() const { return storage.size() * sizeof(Node); }
+
+    /** Find the first key greater or equal than a key.
+     *
+     * prefix  = key_prefix() of the key.
+     * compare = compare(i) must compare sorted key i with the key like strcmp().
+     *           Only called if prefixes are equal.
+     *
+     * Returns the index of the sorted key, or NOT_FOUND.
+     */
+    template<typename Compare>
+    uint32_t lower_bound(const uint64_t prefix, const Compare& compare) const
+    {
+        const Node* const n = nodes();
+        size_t i = 1;
+        while(i <= count)
+        {
+            // Prefetching past the end is harmless (prefetches never fault).
+            __builtin_prefetch(n + 4 * i);
+            const Node& node = n[i];
+            const bool less = node.prefix < prefix ||
+                              (node.prefix == prefix && compare(node.index) < 0);
+            i = 2 * i + less;
+        }
+        // After the last node greater or equal than key we went left, and then only
+        // right; strip those right turns (trailing 1 bits) and the left turn.
+        i >>= __builtin_ffsll(~static_cast<long long>(i));
+        return i == 0 ? NOT_FOUND : n[i].index;
+    }
+};
+
+#endif /* end of include guard: EYTZINGER_H_OCNJMXQB */
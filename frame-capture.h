@@ -0,0 +1,314 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef FRAME_CAPTURE_H_PXHGJSVA
+#define FRAME_CAPTURE_H_PXHGJSVA
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "diy.h"
+
+/// Zones of a frame captured by FrameCapture.
+struct CapturedFrame
+{
+    // Number of the frame, counting from the first frame FrameCapture got.
+    uint64_t index;
+    uint64_t duration_ns;
+    // Duration percentile of frames in the window that the frame exceeded.
+    uint64_t threshold_ns;
+    // Zones of the frame (including the Frame itself) ordered by start.
+    std::vector<ZoneRecord> zones;
+    // Number of zones of the frame that didn't fit into the window.
+    size_t lost_zones;
+};
+
+/** Captures zones of frames much slower than usual ("spikes"); a ZoneCollector sink.
+ *
+ * Averages (perf, CallTree) hide rare spikes, and recording everything to find them
+ * takes unbounded memory. FrameCapture keeps zones of only the last frames, in a rolling
+ * window of fixed size. When a frame ends, its duration is compared with a percentile of
+ * durations of frames in the window; if it's slower, its zones are copied out of the
+ * window and saved. Only the slowest max_captured frames are kept.
+ *
+ * Frames are those of one thread: the first one that ends a Frame. Zones of other
+ * threads are ignored. Zones that are not in a Frame are not in any frame.
+ *
+ * Not thread-safe: add records from one thread (e.g. as the sink of a ZoneCollector)
+ * and read captured frames once the collector stops.
+ */
+class FrameCapture
+{
+public:
+    /// Frames needed in the window before any frame is considered a spike.
+    static const size_t MIN_FRAMES = 10;
+
+private:
+    const double percentile;
+
+    const size_t max_captured;
+
+    // Ring of zone records of the last frames. Fixed size.
+    std::vector<ZoneRecord> records;
+    // Number of records ever added to the ring.
+    uint64_t records_added;
+    // Index of the first record of the frame in progress.
+    uint64_t frame_first_record;
+
+    // Ring of durations of the last frames. Fixed size.
+    std::vector<uint64_t> frames;
+    // Number of frames ever ended.
+    uint64_t frame_count;
+
+    uint32_t frame_thread;
+    bool have_frame_thread;
+
+    // Copy of frames; reused to find the percentile.
+    std::vector<uint64_t> durations;
+
+    std::vector<CapturedFrame> captured_;
+
+    uint64_t spikes_;
+
+    /// Get a record of the window by its index (counting all records ever added).
+    const ZoneRecord& record(const uint64_t index) const
+    {
+        return records[index % records.size()];
+    }
+
+    /// Duration percentile of frames in the window; the frame that just ended excluded.
+    uint64_t threshold()
+    {
+        const size_t count =
+            static_cast<size_t>(std::min<uint64_t>(frame_count, frames.size()));
+        durations.assign(frames.begin(), frames.begin() + count);
+        const size_t nth =
+            std::min(count - 1, static_cast<size_t>(percentile / 100.0 * count));
+        std::nth_element(durations.begin(), durations.begin() + nth, durations.end());
+        return durations[nth];
+    }
+
+    /// Save zones of a frame ending with record frame, starting at record first.
+    void capture(const ZoneRecord& frame, const uint64_t first, const uint64_t duration_ns,
+                 const uint64_t threshold_ns)
+    {
+        ++spikes_;
+        // Keep the slowest frames: replace the fastest captured one if full.
+        auto replaced = captured_.end();
+        if(captured_.size() == max_captured)
+        {
+            replaced = std::min_element(captured_.begin(), captured_.end(),
+                [](const CapturedFrame& a, const CapturedFrame& b)
+                { return a.duration_ns < b.duration_ns; });
+            if(max_captured == 0 || replaced->duration_ns >= duration_ns)
+            {
+                return;
+            }
+        }
+
+        CapturedFrame spike{frame_count, duration_ns, threshold_ns, {}, 0};
+        // Records older than the window size are overwritten.
+        const uint64_t oldest = records_added > records.size() ? records_added - records.size()
+                                                               : 0;
+        spike.lost_zones = static_cast<size_t>(first < oldest ? oldest - first : 0);
+        for(uint64_t r = std::max(first, oldest); r < records_added; ++r)
+        {
+            // Zones that started before the frame are not in it (e.g. zones between
+            // frames, or a zone around the whole loop).
+            if(record(r).start >= frame.start)
+            {
+                spike.zones.push_back(record(r));
+            }
+        }
+        spike.zones.push_back(frame);
+        std::sort(spike.zones.begin(), spike.zones.end(),
+                  [](const ZoneRecord& a, const ZoneRecord& b)
+                  { return a.start < b.start || (a.start == b.start && a.depth < b.depth); });
+
+        if(replaced == captured_.end())
+        {
+            captured_.push_back(std::move(spike));
+        }
+        else
+        {
+            *replaced = std::move(spike);
+        }
+    }
+
+    /// Handle the end of a frame.
+    void end_frame(const ZoneRecord& frame)
+    {
+        const uint64_t duration_ns = ticks_to_nsecs(frame.end) - ticks_to_nsecs(frame.start);
+        if(frame_count >= MIN_FRAMES)
+        {
+            const uint64_t threshold_ns = threshold();
+            if(duration_ns > threshold_ns)
+            {
+                capture(frame, frame_first_record, duration_ns, threshold_ns);
+            }
+        }
+        frames[frame_count % frames.size()] = duration_ns;
+        ++frame_count;
+        frame_first_record = records_added;
+    }
+
+public:
+    /** Construct a FrameCapture.
+     *
+     * window_frames = Number of frames in the window (to compute the percentile from).
+     * percentile    = Frames slower than this percentile of the window are captured.
+     * max_captured  = Maximum number of frames to keep (the slowest are kept).
+     * max_records   = Number of zone records in the window (32 bytes each). Zones of a
+     *                 frame with more zones than this are lost from its timeline.
+     */
+    explicit FrameCapture(const size_t window_frames = 128, const double percentile = 99.0,
+                          const size_t max_captured = 16,
+                          const size_t max_records  = 1 << 16)
+        : percentile(percentile)
+        , max_captured(max_captured)
+        , records(std::max<size_t>(1, max_records))
+        , records_added(0)
+        , frame_first_record(0)
+        , frames(std::max<size_t>(1, window_frames))
+        , frame_count(0)
+        , frame_thread(0)
+        , have_frame_thread(false)
+        , spikes_(0)
+    {
+        durations.reserve(frames.size());
+        captured_.reserve(max_captured);
+    }
+
+    /// Add records of finished zones of a thread.
+    void add(const uint32_t thread, const ZoneRecord* const zones, const size_t count)
+    {
+        const ZoneId frame_id = frame_zone_id();
+        for(size_t z = 0; z < count; ++z)
+        {
+            const ZoneRecord& zone = zones[z];
+            if(!have_frame_thread && zone.zone == frame_id)
+            {
+                frame_thread      = thread;
+                have_frame_thread = true;
+            }
+            if(!have_frame_thread || thread != frame_thread)
+            {
+                continue;
+            }
+            if(zone.zone == frame_id)
+            {
+                end_frame(zone);
+                continue;
+            }
+            records[records_added % records.size()] = zone;
+            ++records_added;
+        }
+    }
+
+    /// A ZoneCollector sink adding records. The capture must outlive the collector.
+    ZoneCollector::Sink sink()
+    {
+        return [this](uint32_t thread, const ZoneRecord* zones, size_t count)
+        {
+            add(thread, zones, count);
+        };
+    }
+
+    /// Captured frames, in no particular order.
+    const std::vector<CapturedFrame>& captured() const { return captured_; }
+
+    /// Number of frames so far.
+    uint64_t frames_seen() const { return frame_count; }
+
+    /// Number of frames slower than the threshold so far (including those not kept).
+    uint64_t spikes() const { return spikes_; }
+
+    /// Memory used by the window, in bytes.
+    size_t window_bytes() const
+    {
+        return records.size() * sizeof(ZoneRecord) + frames.size() * sizeof(uint64_t);
+    }
+
+    /// Print timelines of captured frames, in frame order. Times in us, from frame start.
+    void report(std::ostream& out) const
+    {
+        std::vector<const CapturedFrame*> sorted;
+        for(const auto& frame: captured_)
+        {
+            sorted.push_back(&frame);
+        }
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const CapturedFrame* a, const CapturedFrame* b)
+                  { return a->index < b->index; });
+
+        const auto flags     = out.flags();
+        const auto precision = out.precision();
+        out << std::fixed << std::setprecision(3) << spikes_ << " of " << frame_count
+            << " frames slower than the " << percentile << "th percentile of the last "
+            << frames.size() << ", " << captured_.size() << " slowest kept:\n";
+        for(const CapturedFrame* const frame: sorted)
+        {
+            out << "frame " << frame->index << ": " << frame->duration_ns / 1e3
+                << " us (threshold " << frame->threshold_ns / 1e3 << " us)";
+            if(frame->lost_zones != 0)
+            {
+                out << ", " << frame->lost_zones << " zones lost";
+            }
+            out << "\n       start    duration   zone\n";
+            const uint64_t frame_start = ticks_to_nsecs(frame->zones.front().start);
+            const uint32_t frame_depth = frame->zones.front().depth;
+            for(const ZoneRecord& zone: frame->zones)
+            {
+                const uint64_t start = ticks_to_nsecs(zone.start);
+                const uint32_t indent = zone.depth > frame_depth ? zone.depth - frame_depth : 0;
+                out << std::setw(12) << (start - frame_start) / 1e3 << std::setw(12)
+                    << (ticks_to_nsecs(zone.end) - start) / 1e3 << "   "
+                    << std::string(2 * indent, ' ') << zone_name(zone.zone) << "\n";
+            }
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+/** Records zones while it exists and prints timelines of spike frames when destroyed.
+ *
+ * E.g. at the beginning of main(). Only one may exist at a time (it has a ZoneCollector).
+ */
+class SpikeReport
+{
+private:
+    std::ostream& out;
+
+    FrameCapture capture;
+
+    ZoneCollector collector;
+
+public:
+    explicit SpikeReport(std::ostream& out = std::cout, const size_t window_frames = 128,
+                         const double percentile = 99.0, const size_t max_captured = 16)
+        : out(out)
+        , capture(window_frames, percentile, max_captured)
+        , collector(capture.sink())
+    {
+    }
+
+    ~SpikeReport()
+    {
+        collector.stop();
+        capture.report(out);
+        if(collector.overflows() != 0)
+        {
+            out << collector.overflows() << " records dropped by full zone buffers\n";
+        }
+    }
+};
+
+#endif /* end of include guard: FRAME_CAPTURE_H_PXHGJSVA */
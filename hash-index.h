@@ -0,0 +1,243 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef HASH_INDEX_H_HBXQEWTO
+#define HASH_INDEX_H_HBXQEWTO
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Flat open-addressing hash index: maps key hashes to indices of sorted entries.
+ *
+ * Each slot is 8 bytes: a 32-bit entry index and 32 bits of metadata (24-bit hash
+ * fingerprint and 8-bit probe distance), so 8 slots share a cache line.
+ *
+ * We use linear probing with Robin Hood insertion: an entry far from its home slot takes
+ * the slot of an entry closer to its own home. This keeps probe sequences short, and a
+ * lookup can give up as soon as it sees an entry closer to its home than our key would
+ * be - so misses are cheap too.
+ *
+ * The index only stores fingerprints and indices; the caller compares the actual keys.
+ *
+ * A built index is a flat array of slots with no pointers, so it can be saved to a file
+ * (data(), bytes()) and used directly from a mapping of that file (view()).
+ */
+class HashIndex
+{
+private:
+    struct Slot
+    {
+        uint32_t index;
+        // Fingerprint in the upper 24 bits, probe distance + 1 in the lower 8 bits.
+        // 0 if the slot is empty.
+        uint32_t meta;
+    };
+
+    // Longest probe distance we can store. If we get further, the table is resized.
+    static const uint32_t MAX_DISTANCE = 254;
+
+    // Slots of a built index; empty if not built or if this is a view().
+    std::vector<Slot> slots;
+
+    // Slots of a view() of a saved index, or nullptr.
+    const Slot* viewed = nullptr;
+
+    // Number of slots - 1; number of slots is a power of two (or 0 if not built).
+    size_t mask = 0;
+
+    /// Slots of the index, whether built or viewed.
+    const Slot* table() const { return viewed != nullptr ? viewed : slots.data(); }
+
+    /// Fingerprint of a hash. The low bits of the hash select the slot, so use high bits.
+    static uint32_t fingerprint(const uint64_t hash)
+    {
+        return static_cast<uint32_t>(hash >> 40);
+    }
+
+    /// Try to insert all hashes with specified capacity. Returns false if a probe
+    /// sequence gets too long.
+    bool insert_all(const std::vector<uint64_t>& hashes, const size_t capacity)
+    {
+        Slot empty;
+        empty.index = 0;
+        empty.meta  = 0;
+        slots.assign(capacity, empty);
+        viewed = nullptr;
+        mask   = capacity - 1;
+
+        for(size_t i = 0; i < hashes.size(); ++i)
+        {
+            Slot slot;
+            slot.index = static_cast<uint32_t>(i);
+            uint32_t fp   = fingerprint(hashes[i]);
+            uint32_t dist = 0;
+            for(size_t s = static_cast<size_t>(hashes[i]) & mask;; s = (s + 1) & mask, ++dist)
+            {
+                if(dist > MAX_DISTANCE)
+                {
+                    return false;
+                }
+                slot.meta = (fp << 8) | (dist + 1);
+                if(slots[s].meta == 0)
+                {
+                    slots[s] = slot;
+                    break;
+                }
+                // Robin Hood: take the slot from an entry closer to its home, and go on
+                // inserting that entry instead.
+                const uint32_t other_dist = (slots[s].meta & 0xFF) - 1;
+                if(other_dist < dist)
+                {
+                    std::swap(slots[s], slot);
+                    fp   = slot.meta >> 8;
+                    dist = other_dist;
+                }
+            }
+        }
+        return true;
+    }
+
+public:
+    /// Returned by find() if there is no matching entry.
+    static const uint32_t NOT_FOUND = UINT32_MAX;
+
+    /** Build the index.
+     *
+     * count   = Number of entries.
+     * hash_of = hash_of(i) must return the hash of the key of entry i.
+     */
+    template<typename HashOf>
+    void build(const size_t count, const HashOf& hash_of)
+    {
+        std::vector<uint64_t> hashes(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            hashes[i] = hash_of(i);
+        }
+
+        // Keep the load factor at or below 50%.
+        size_t capacity = 16;
+        while(capacity < count * 2)
+        {
+            capacity *= 2;
+        }
+        while(!insert_all(hashes, capacity))
+        {
+            capacity *= 2;
+        }
+    }
+
+    /** Use a saved index without copying it.
+     *
+     * data  = data() of a built index, saved by the caller. Must stay valid as long as
+     *         this index is used, and be aligned to 4 bytes.
+     * bytes = bytes() of the built index.
+     *
+     * Returns false if bytes is not a valid index size.
+     */
+    bool view(const void* const data, const size_t bytes)
+    {
+        const size_t count = bytes / sizeof(Slot);
+        if(bytes % sizeof(Slot) != 0 || count < 16 || (count & (count - 1)) != 0)
+        {
+            return false;
+        }
+        slots.clear();
+        viewed = static_cast<const Slot*>(data);
+        mask   = count - 1;
+        return true;
+    }
+
+    /** Check a view() of a saved index against the entries it indexes.
+     *
+     * Returns true if all slots refer to entries below count, and some slot is empty so
+     * that every find() ends. O(slots).
+     */
+    bool check(const size_t count) const
+    {
+        const Slot* const slot_table = table();
+        bool has_empty = false;
+        for(size_t s = 0; s <= mask; ++s)
+        {
+            const Slot slot = slot_table[s];
+            if(slot.meta == 0)
+            {
+                has_empty = true;
+            }
+            else if(slot.index >= count)
+            {
+                return false;
+            }
+        }
+        return has_empty;
+    }
+
+    /// Has the index been built (or viewed)?
+    bool empty() const { return slots.empty() && viewed == nullptr; }
+
+    /// Raw data of the index, bytes() long; see view().
+    const void* data() const { return table(); }
+
+    /// Size of the index in bytes.
+    size_t bytes() const { return empty() ? 0 : (mask + 1) * sizeof(Slot); }
+
+    /** First entry with a matching fingerprint for each of count hashes.
+     *
+     * Used for batched lookups: prefetches the home slots of all hashes before reading
+     * any of them, so their cache misses overlap.
+     *
+     * The caller must check that the candidate's key matches. If it doesn't, the key may
+     * still be further in the probe sequence (fingerprints can collide); use find().
+     *
+     * hashes     = Hashes of keys to look for.
+     * count      = Number of hashes.
+     * candidates = Candidate entry indices (or NOT_FOUND) are written here.
+     */
+    void candidates(const uint64_t* const hashes, const size_t count,
+                    uint32_t* const candidates) const
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            __builtin_prefetch(table() + (static_cast<size_t>(hashes[i]) & mask));
+        }
+        for(size_t i = 0; i < count; ++i)
+        {
+            candidates[i] = find(hashes[i], [](const uint32_t) { return true; });
+        }
+    }
+
+    /** Find an entry by hash of its key.
+     *
+     * hash    = Hash of the key.
+     * matches = matches(i) must return true if entry i has the key we're looking for.
+     *           Only called for entries with matching fingerprints.
+     *
+     * Returns the index of the entry, or NOT_FOUND.
+     */
+    template<typename Matches>
+    uint32_t find(const uint64_t hash, const Matches& matches) const
+    {
+        const Slot* const slot_table = table();
+        const uint32_t fp = fingerprint(hash);
+        uint32_t dist = 0;
+        for(size_t s = static_cast<size_t>(hash) & mask;; s = (s + 1) & mask, ++dist)
+        {
+            const Slot slot = slot_table[s];
+            // Empty, or an entry closer to home than we would be: we'd have taken its slot.
+            if(slot.meta == 0 || (slot.meta & 0xFF) - 1 < dist)
+            {
+                return NOT_FOUND;
+            }
+            if((slot.meta >> 8) == fp && matches(slot.index))
+            {
+                return slot.index;
+            }
+        }
+    }
+};
+
+#endif /* end of include guard: HASH_INDEX_H_HBXQEWTO */
@@ -0,0 +1,54 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef HASH_H_RLNBVUGE
+#define HASH_H_RLNBVUGE
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** A fast 64-bit string hash.
+ *
+ * Not cryptographic (don't use on untrusted keys if collisions matter). Reads 8 bytes
+ * at a time and mixes with multiplications; the final mix spreads entropy to all bits,
+ * so both low bits (for table slots) and high bits (for fingerprints) are usable.
+ */
+
+
+/// Final mix (from MurmurHash3): every input bit affects every output bit.
+inline uint64_t hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/// Hash size bytes at data, with an optional seed to get independent hash functions.
+inline uint64_t hash_bytes(const char* data, size_t size, const uint64_t seed = 0)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = (seed + size) * multiplier;
+    while(size >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        h = (h ^ hash_mix(word)) * multiplier;
+        data += 8;
+        size -= 8;
+    }
+    if(size > 0)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data, size);
+        h = (h ^ hash_mix(word)) * multiplier;
+    }
+    return hash_mix(h);
+}
+
+#endif /* end of include guard: HASH_H_RLNBVUGE */
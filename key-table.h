@@ -0,0 +1,199 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef KEY_TABLE_H_MDWQPTXN
+#define KEY_TABLE_H_MDWQPTXN
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cfg5-noalloc.h"
+
+/** Interned keys a program reads often, with their IDs in the current CFG.
+ *
+ * Hot code shouldn't look up the same key strings over and over. Instead, keys are
+ * interned once at startup (intern() returns a Key: a stable small integer), resolved
+ * to CFG::KeyId entry indices whenever the config is (re)loaded, and then read with
+ * CFG::at() in O(1) - no hashing, no string comparisons.
+ *
+ * Re-resolving after a reload is cheap: each key is first checked at its old ID in the
+ * new CFG (two string comparisons), then at its old ID moved as much as the previous key
+ * (in entry order) moved. Most reloads only change values or a few keys: entries stay at
+ * the same index, or an added or removed key moves all entries after it by the same
+ * amount. Only keys that are not at either place are looked up again.
+ *
+ * Not thread-safe: resolve() changes the IDs. With a ConfigHandle, resolve a table for
+ * each acquired CFG, or give each reader thread its own table.
+ */
+class KeyTable
+{
+public:
+    /// An interned key: index of the key in the table. Stable across resolve() calls.
+    typedef uint32_t Key;
+
+private:
+    /// A section and key of an interned key, as spans of strings.
+    struct Interned
+    {
+        Span section;
+        Span key;
+    };
+
+    // Section names and keys of interned keys, one after another.
+    std::vector<char> strings;
+
+    std::vector<Interned> keys;
+
+    // Interned keys by section + '\0' + key; so intern() doesn't add duplicates.
+    std::unordered_map<std::string, Key> by_name;
+
+    // ID of each key in the CFG of the last resolve() (NO_KEY if not found), and index of
+    // the section it was in there.
+    std::vector<CFG::KeyId> ids;
+    std::vector<uint32_t> key_sections;
+
+    // Keys in order of their IDs; reused by resolve() so it doesn't allocate.
+    std::vector<Key> by_id;
+
+    /// Get a string of an interned key.
+    Slice<const char> slice(const Span span) const
+    {
+        return Slice<const char>(strings.data() + span.offset, span.length);
+    }
+
+    /// Add a string to strings.
+    Span add(const Slice<const char> string)
+    {
+        const Span span{static_cast<uint32_t>(strings.size()),
+                        static_cast<uint32_t>(string.size())};
+        strings.insert(strings.end(), string.begin(), string.end());
+        return span;
+    }
+
+    /// Is the entry with ID id of cfg in section s still the entry of interned key k?
+    bool still_at(const CFG& cfg, const Key k, const size_t s, const int64_t id) const
+    {
+        if(id < 0 || id >= static_cast<int64_t>(cfg.size()) || s >= cfg.section_count())
+        {
+            return false;
+        }
+        const auto entry = cfg.begin() + id;
+        return entry >= cfg.section_begin(s) && entry < cfg.section_end(s) &&
+               cfg.key(*entry) == key(k) && cfg.section_name(s) == section(k);
+    }
+
+public:
+    /** Intern a key in a section (empty for the unnamed section).
+     *
+     * Returns the Key of the key; the same Key if it's already interned. The ID of a new
+     * key is NO_KEY until the next resolve().
+     */
+    Key intern(const Slice<const char> section, const Slice<const char> key)
+    {
+        std::string name(section.ptr(), section.size());
+        name.push_back('\0');
+        name.append(key.ptr(), key.size());
+        const auto found = by_name.find(name);
+        if(found != by_name.end())
+        {
+            return found->second;
+        }
+        const Key k = static_cast<Key>(keys.size());
+        const Span section_span = add(section);
+        keys.push_back(Interned{section_span, add(key)});
+        // A copy: push_back() takes a reference, and NO_KEY has no definition to refer to.
+        ids.push_back(static_cast<CFG::KeyId>(CFG::NO_KEY));
+        key_sections.push_back(0);
+        by_id.push_back(k);
+        by_name[name] = k;
+        return k;
+    }
+
+    /// Intern a key in the unnamed section.
+    Key intern(const Slice<const char> key)
+    {
+        return intern(Slice<const char>(nullptr, 0), key);
+    }
+
+    Key intern(const char* const key)
+    {
+        return intern(Slice<const char>(key, strlen(key)));
+    }
+
+    Key intern(const char* const section, const char* const key)
+    {
+        return intern(Slice<const char>(section, strlen(section)),
+                      Slice<const char>(key, strlen(key)));
+    }
+
+    /// Number of interned keys.
+    size_t size() const { return keys.size(); }
+
+    /// Section of an interned key.
+    Slice<const char> section(const Key k) const { return slice(keys[k].section); }
+
+    /// An interned key.
+    Slice<const char> key(const Key k) const { return slice(keys[k].key); }
+
+    /** Find IDs of all interned keys in a CFG, e.g. after loading a new version.
+     *
+     * Keys are first looked for near their IDs in the previously resolved CFG (see
+     * above); only keys that are not there are looked up.
+     *
+     * Returns the number of keys that had to be looked up.
+     */
+    size_t resolve(const CFG& cfg)
+    {
+        assert(cfg.is_valid());
+        // NO_KEY is the largest ID, so keys not found last time are at the end.
+        std::sort(by_id.begin(), by_id.end(),
+                  [this](const Key a, const Key b) { return ids[a] < ids[b]; });
+        size_t lookups = 0;
+        // How much the previous key moved.
+        int64_t moved = 0;
+        for(const Key k: by_id)
+        {
+            const CFG::KeyId old_id = ids[k];
+            if(old_id != CFG::NO_KEY && still_at(cfg, k, key_sections[k], old_id))
+            {
+                moved = 0;
+                continue;
+            }
+            if(old_id != CFG::NO_KEY && moved != 0 &&
+               still_at(cfg, k, key_sections[k], old_id + moved))
+            {
+                ids[k] = static_cast<CFG::KeyId>(old_id + moved);
+                continue;
+            }
+            ++lookups;
+            const auto sec = section(k);
+            ids[k] = sec.empty() ? cfg.resolve(key(k)) : cfg.resolve(sec, key(k));
+            if(ids[k] != CFG::NO_KEY)
+            {
+                key_sections[k] = static_cast<uint32_t>(cfg.section_of(cfg.at(ids[k])));
+                if(old_id != CFG::NO_KEY)
+                {
+                    moved = static_cast<int64_t>(ids[k]) - old_id;
+                }
+            }
+        }
+        return lookups;
+    }
+
+    /// ID of an interned key in the CFG of the last resolve(); NO_KEY if it's not there.
+    CFG::KeyId id(const Key k) const
+    {
+        assert(k < ids.size());
+        return ids[k];
+    }
+};
+
+#endif /* end of include guard: KEY_TABLE_H_MDWQPTXN */
@@ -0,0 +1,243 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef LINE_CHUNKS_H_PFHXQDOA
+#define LINE_CHUNKS_H_PFHXQDOA
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+
+/** Finding changed parts of a text by hashes of chunks of lines.
+ *
+ * Two versions of a text are compared in two steps. First, the common prefix and suffix
+ * are skipped with memcmp(); for a single edit that's all we need. Then the part between
+ * them is split into chunks of whole lines and compared chunk by chunk. Chunk boundaries
+ * depend on the content of lines, not on their positions: a chunk ends after a line
+ * whose hash has its low bits zero. So inserting or removing lines only changes the
+ * chunk they're in; the chunks after it are the same as before, just at different
+ * offsets, and unchanged text between several edits is found.
+ */
+
+
+/// A chunk of whole lines of a text.
+struct LineChunk
+{
+    // Hash of the text of the chunk.
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t length;
+};
+
+/// A chunk ends after a line whose hash has these bits zero (64 lines on average)...
+const uint64_t LINE_CHUNK_MASK = 63;
+
+/// ...or after this many lines.
+const size_t LINE_CHUNK_MAX_LINES = 1024;
+
+/// A changed part of a text: bytes [old_begin, old_end) of the old version were replaced
+/// by bytes [new_begin, new_end) of the new version. Both are whole lines.
+struct TextEdit
+{
+    uint32_t old_begin;
+    uint32_t old_end;
+    uint32_t new_begin;
+    uint32_t new_end;
+};
+
+/** Split text into chunks of lines. Lines end with '\n' (a '\r' before it is a part of
+ * the line).
+ *
+ * data/size = Text to split; must start at a line boundary.
+ * base      = Offset of data in the whole text; added to offsets of chunks.
+ */
+inline std::vector<LineChunk> chunk_lines(const char* const data, const size_t size,
+                                          const size_t base = 0)
+{
+    std::vector<LineChunk> chunks;
+    size_t chunk_begin = 0;
+    size_t lines       = 0;
+    uint64_t hash      = 0;
+    for(size_t pos = 0; pos < size;)
+    {
+        const char* const newline =
+            static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+        const size_t line_end = newline == nullptr ? size : newline - data + 1;
+        const uint64_t line_hash = hash_bytes(data + pos, line_end - pos);
+        hash = hash_mix(hash ^ line_hash);
+        pos  = line_end;
+        ++lines;
+        if((line_hash & LINE_CHUNK_MASK) == 0 || lines == LINE_CHUNK_MAX_LINES ||
+           pos == size)
+        {
+            LineChunk chunk;
+            chunk.hash   = hash;
+            chunk.offset = static_cast<uint32_t>(base + chunk_begin);
+            chunk.length = static_cast<uint32_t>(pos - chunk_begin);
+            chunks.push_back(chunk);
+            chunk_begin = pos;
+            lines       = 0;
+            hash        = 0;
+        }
+    }
+    return chunks;
+}
+
+/// Length of the common prefix of a and b, both size bytes long.
+inline size_t common_prefix(const char* const a, const char* const b, const size_t size)
+{
+    // memcmp() big blocks first; it's much faster than comparing bytes.
+    const size_t BLOCK = 4096;
+    size_t pos = 0;
+    while(size - pos >= BLOCK && memcmp(a + pos, b + pos, BLOCK) == 0)
+    {
+        pos += BLOCK;
+    }
+    while(pos < size && a[pos] == b[pos])
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+/// Length of the common suffix of a and b, both size bytes long (pointers to their ends).
+inline size_t common_suffix(const char* const a_end, const char* const b_end,
+                            const size_t size)
+{
+    const size_t BLOCK = 4096;
+    size_t length = 0;
+    while(size - length >= BLOCK &&
+          memcmp(a_end - length - BLOCK, b_end - length - BLOCK, BLOCK) == 0)
+    {
+        length += BLOCK;
+    }
+    while(length < size && a_end[-1 - static_cast<ptrdiff_t>(length)] ==
+                           b_end[-1 - static_cast<ptrdiff_t>(length)])
+    {
+        ++length;
+    }
+    return length;
+}
+
+/** Match chunks of lines of two versions of a text.
+ *
+ * Unchanged chunks at the start and the end are matched first; chunks in between are
+ * matched by hash, in order (a chunk moved before another matched chunk is an edit).
+ * Matched chunks are compared byte by byte, so hash collisions can't hide changes.
+ *
+ * Returns matched (old, new) chunk index pairs, in order.
+ */
+inline std::vector<std::pair<uint32_t, uint32_t>>
+match_line_chunks(const char* const old_data, const std::vector<LineChunk>& old_chunks,
+                  const char* const new_data, const std::vector<LineChunk>& new_chunks)
+{
+    const auto same = [&](const size_t o, const size_t n) {
+        const LineChunk& a = old_chunks[o];
+        const LineChunk& b = new_chunks[n];
+        return a.hash == b.hash && a.length == b.length &&
+               memcmp(old_data + a.offset, new_data + b.offset, a.length) == 0;
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> matches;
+    const size_t old_count = old_chunks.size();
+    const size_t new_count = new_chunks.size();
+    size_t prefix = 0;
+    while(prefix < old_count && prefix < new_count && same(prefix, prefix))
+    {
+        matches.push_back(std::make_pair(prefix, prefix));
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while(suffix < old_count - prefix && suffix < new_count - prefix &&
+          same(old_count - 1 - suffix, new_count - 1 - suffix))
+    {
+        ++suffix;
+    }
+
+    // Chunks in the middle, by hash. Chunks with the same hash are not matched at all.
+    const uint32_t AMBIGUOUS = UINT32_MAX;
+    std::unordered_map<uint64_t, uint32_t> old_by_hash;
+    for(size_t o = prefix; o < old_count - suffix; ++o)
+    {
+        const auto inserted = old_by_hash.insert(std::make_pair(old_chunks[o].hash, o));
+        if(!inserted.second)
+        {
+            inserted.first->second = AMBIGUOUS;
+        }
+    }
+    size_t next_old = prefix;
+    for(size_t n = prefix; n < new_count - suffix; ++n)
+    {
+        const auto found = old_by_hash.find(new_chunks[n].hash);
+        if(found != old_by_hash.end() && found->second != AMBIGUOUS &&
+           found->second >= next_old && same(found->second, n))
+        {
+            matches.push_back(std::make_pair(found->second, n));
+            next_old = found->second + 1;
+        }
+    }
+    for(size_t s = suffix; s > 0; --s)
+    {
+        matches.push_back(std::make_pair(old_count - s, new_count - s));
+    }
+    return matches;
+}
+
+/** Find the edits that turn the old version of a text into the new version.
+ *
+ * Returns edits ordered by position; empty if the versions are the same.
+ */
+inline std::vector<TextEdit> diff_lines(const char* const old_data, const size_t old_size,
+                                        const char* const new_data, const size_t new_size)
+{
+    // Skip the common prefix and suffix, rounded to whole lines.
+    const size_t min_size = std::min(old_size, new_size);
+    size_t prefix = common_prefix(old_data, new_data, min_size);
+    while(prefix > 0 && old_data[prefix - 1] != '\n')
+    {
+        --prefix;
+    }
+    size_t suffix = common_suffix(old_data + old_size, new_data + new_size, min_size - prefix);
+    const char* const suffix_newline =
+        static_cast<const char*>(memchr(old_data + old_size - suffix, '\n', suffix));
+    suffix = suffix_newline == nullptr ? 0 : old_data + old_size - (suffix_newline + 1);
+
+    // Match chunks of lines between them.
+    const size_t old_end = old_size - suffix;
+    const size_t new_end = new_size - suffix;
+    const std::vector<LineChunk> old_chunks =
+        chunk_lines(old_data + prefix, old_end - prefix, prefix);
+    const std::vector<LineChunk> new_chunks =
+        chunk_lines(new_data + prefix, new_end - prefix, prefix);
+    const auto matches = match_line_chunks(old_data, old_chunks, new_data, new_chunks);
+
+    // Edits are the gaps between matched chunks.
+    std::vector<TextEdit> edits;
+    uint32_t old_pos = static_cast<uint32_t>(prefix), new_pos = static_cast<uint32_t>(prefix);
+    const auto add_gap = [&](const uint32_t old_gap_end, const uint32_t new_gap_end) {
+        if(old_gap_end != old_pos || new_gap_end != new_pos)
+        {
+            edits.push_back(TextEdit{old_pos, old_gap_end, new_pos, new_gap_end});
+        }
+    };
+    for(const auto& match: matches)
+    {
+        const LineChunk& a = old_chunks[match.first];
+        const LineChunk& b = new_chunks[match.second];
+        add_gap(a.offset, b.offset);
+        old_pos = a.offset + a.length;
+        new_pos = b.offset + b.length;
+    }
+    add_gap(static_cast<uint32_t>(old_end), static_cast<uint32_t>(new_end));
+    return edits;
+}
+
+#endif /* end of include guard: LINE_CHUNKS_H_PFHXQDOA */
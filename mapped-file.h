@@ -0,0 +1,125 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MAPPED_FILE_H_QPZRWMNE
+#define MAPPED_FILE_H_QPZRWMNE
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// POSIX ONLY! A Windows version would use CreateFileMapping()/MapViewOfFile().
+
+/** A file mapped into memory with mmap().
+ *
+ * The mapping is read-only, and shares its pages with every other process mapping the
+ * same file.
+ *
+ * Not copyable; use swap() to move the mapping around.
+ */
+class MappedFile
+{
+private:
+    const char* data_ = nullptr;
+
+    size_t size_ = 0;
+
+public:
+    MappedFile() {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /** Map a file into memory.
+     *
+     * The kernel is advised that the file will be read front to back (for parsing); see
+     * end_sequential().
+     *
+     * Returns false if the file can't be opened or mapped (empty files can't be mapped).
+     */
+    bool open(const std::string& filename)
+    {
+        close();
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            return false;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        const size_t size = static_cast<size_t>(st.st_size);
+        void* const data  = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+        if(data == MAP_FAILED)
+        {
+            return false;
+        }
+
+        data_ = static_cast<const char*>(data);
+        size_ = size;
+        // We parse front to back: let the kernel read ahead aggressively and drop pages
+        // behind us.
+        madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    /** Advise the kernel that the file is no longer read front to back.
+     *
+     * Call once done parsing: MADV_SEQUENTIAL lets the kernel drop pages behind the
+     * reader, but lookups then read the mapping at random.
+     */
+    void end_sequential() const
+    {
+        if(data_ != nullptr)
+        {
+            madvise(const_cast<char*>(data_), size_, MADV_NORMAL);
+        }
+    }
+
+    /// Unmap the file (if mapped).
+    void close()
+    {
+        if(data_ != nullptr)
+        {
+            munmap(const_cast<char*>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    /// Is a file mapped?
+    bool is_open() const { return data_ != nullptr; }
+
+    /// Pointer to the first byte of the mapping.
+    const char* data() const { return data_; }
+
+    /// Size of the mapped file in bytes.
+    size_t size() const { return size_; }
+
+    friend void swap(MappedFile& first, MappedFile& second) noexcept
+    {
+        std::swap(first.data_, second.data_);
+        std::swap(first.size_, second.size_);
+    }
+};
+
+#endif /* end of include guard: MAPPED_FILE_H_QPZRWMNE */
@@ -0,0 +1,201 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef PARALLEL_H_ZKCYWQDS
+#define PARALLEL_H_ZKCYWQDS
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/** Helpers for parsing big files on multiple threads.
+ *
+ * The text is split into chunks at line boundaries, each chunk is scanned and sorted by
+ * its own thread into a sorted run, and then the runs are merged in parallel: the key
+ * range is split into partitions by splitter keys sampled from the runs and each thread
+ * merges one partition of every run into its own part of the output.
+ */
+
+
+/// Resolve a thread count knob: 0 means one thread per hardware thread.
+inline unsigned resolve_threads(const unsigned threads)
+{
+    if(threads != 0)
+    {
+        return threads;
+    }
+    const unsigned hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+/** Call fn(i) for each i in [0, count), each on its own thread.
+ *
+ * fn(0) runs on the calling thread. Returns after all calls return.
+ */
+template<typename F>
+void run_parallel(const unsigned count, const F& fn)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for(unsigned i = 1; i < count; ++i)
+    {
+        workers.push_back(std::thread(fn, i));
+    }
+    if(count > 0)
+    {
+        fn(0);
+    }
+    for(auto& worker: workers)
+    {
+        worker.join();
+    }
+}
+
+/** Split text into at most count chunks that start at line boundaries.
+ *
+ * data/size = Text to split.
+ * count     = Maximum number of chunks.
+ * min_size  = Minimum size of a chunk (except the last one); avoids many tiny chunks.
+ *
+ * Returns chunk boundaries: chunk i is [result[i], result[i + 1]). The first boundary is
+ * 0 and the last is size.
+ */
+inline std::vector<size_t> split_lines(const char* const data, const size_t size,
+                                       const unsigned count, const size_t min_size)
+{
+    std::vector<size_t> bounds(1, 0);
+    const size_t chunk_size = std::max(size / std::max(count, 1u), min_size);
+    while(bounds.size() < count && size - bounds.back() > chunk_size)
+    {
+        // Cut after the first newline following the ideal boundary. Lines may end with
+        // '\r', '\n' or both; a cut after '\n' is a line boundary in every case.
+        const char* const ideal = data + bounds.back() + chunk_size;
+        const char* const newline = std::find(ideal, data + size, '\n');
+        if(newline == data + size)
+        {
+            break;
+        }
+        bounds.push_back(newline + 1 - data);
+    }
+    bounds.push_back(size);
+    return bounds;
+}
+
+/** Merge sorted runs on multiple threads and find duplicates while at it.
+ *
+ * runs    = Runs to merge; each must be sorted by cmp.
+ * out     = Merged runs are written here.
+ * threads = Number of threads to merge on.
+ * cmp     = Three-way comparison: cmp(a, b) < 0 if a < b, 0 if equal, > 0 if a > b.
+ *
+ * Returns the index of the first element in out equal to its predecessor, or out.size()
+ * if there are no duplicates.
+ */
+template<typename T, typename Compare>
+size_t parallel_merge(const std::vector<std::vector<T>>& runs, std::vector<T>& out,
+                      const unsigned threads, const Compare& cmp)
+{
+    const auto less = [&cmp](const T& a, const T& b) { return cmp(a, b) < 0; };
+
+    size_t total = 0;
+    for(const auto& run: runs)
+    {
+        total += run.size();
+    }
+    out.resize(total);
+    const unsigned partitions = std::max(1u, threads);
+
+    // Sample each run evenly and pick splitters from the sorted samples.
+    const size_t samples_per_run = 16 * partitions;
+    std::vector<T> samples;
+    for(const auto& run: runs)
+    {
+        for(size_t s = 0; s < samples_per_run && s < run.size(); ++s)
+        {
+            samples.push_back(run[s * run.size() / samples_per_run]);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), less);
+    std::vector<T> splitters;
+    for(unsigned p = 1; p < partitions && !samples.empty(); ++p)
+    {
+        splitters.push_back(samples[p * samples.size() / partitions]);
+    }
+
+    // bounds[p][r] is where partition p starts in run r. All elements equal to a splitter
+    // are in the same partition, so duplicates never straddle partitions.
+    const size_t partition_count = splitters.size() + 1;
+    std::vector<std::vector<size_t>> bounds(partition_count + 1,
+                                            std::vector<size_t>(runs.size()));
+    for(size_t r = 0; r < runs.size(); ++r)
+    {
+        bounds[0][r] = 0;
+        for(size_t p = 1; p < partition_count; ++p)
+        {
+            bounds[p][r] = std::lower_bound(runs[r].begin(), runs[r].end(),
+                                            splitters[p - 1], less) - runs[r].begin();
+        }
+        bounds[partition_count][r] = runs[r].size();
+    }
+
+    // Where each partition starts in out.
+    std::vector<size_t> out_starts(partition_count + 1, 0);
+    for(size_t p = 0; p < partition_count; ++p)
+    {
+        out_starts[p + 1] = out_starts[p];
+        for(size_t r = 0; r < runs.size(); ++r)
+        {
+            out_starts[p + 1] += bounds[p + 1][r] - bounds[p][r];
+        }
+    }
+
+    std::vector<size_t> duplicates(partition_count, total);
+    run_parallel(static_cast<unsigned>(partition_count), [&](const unsigned p) {
+        // K-way merge using a heap of run indices ordered by their current heads.
+        std::vector<size_t> heads(bounds[p]);
+        const std::vector<size_t>& ends = bounds[p + 1];
+        std::vector<size_t> heap;
+        for(size_t r = 0; r < runs.size(); ++r)
+        {
+            if(heads[r] < ends[r])
+            {
+                heap.push_back(r);
+            }
+        }
+        // std heap is a max-heap; invert the comparison to get the smallest head on top.
+        const auto heap_less = [&](const size_t a, const size_t b) {
+            return less(runs[b][heads[b]], runs[a][heads[a]]);
+        };
+        std::make_heap(heap.begin(), heap.end(), heap_less);
+
+        size_t o = out_starts[p];
+        while(!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), heap_less);
+            const size_t r = heap.back();
+            out[o] = runs[r][heads[r]];
+            if(o > out_starts[p] && duplicates[p] == total && cmp(out[o - 1], out[o]) == 0)
+            {
+                duplicates[p] = o;
+            }
+            ++o;
+            if(++heads[r] < ends[r])
+            {
+                std::push_heap(heap.begin(), heap.end(), heap_less);
+            }
+            else
+            {
+                heap.pop_back();
+            }
+        }
+        assert(o == out_starts[p + 1]);
+    });
+
+    return *std::min_element(duplicates.begin(), duplicates.end());
+}
+
+#endif /* end of include guard: PARALLEL_H_ZKCYWQDS */
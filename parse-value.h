@@ -0,0 +1,203 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef PARSE_VALUE_H_HNXBQELP
+#define PARSE_VALUE_H_HNXBQELP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <locale.h>
+
+/** Conversions of CFG values to numbers and bools.
+ *
+ * Unlike std::stoi()/std::stod(), these work on (pointer, size) without copying the
+ * value into a std::string, don't depend on the current locale (the decimal point is
+ * always '.') and fail instead of ignoring trailing garbage.
+ */
+
+
+/** Parse a decimal integer: optional '+' or '-' followed by digits.
+ *
+ * Returns false if the value is not an integer or doesn't fit into int64_t.
+ */
+inline bool parse_int(const char* const data, const size_t size, int64_t& result)
+{
+    size_t i = 0;
+    const bool negative = size > 0 && data[0] == '-';
+    if(size > 0 && (data[0] == '-' || data[0] == '+'))
+    {
+        ++i;
+    }
+    if(i == size)
+    {
+        return false;
+    }
+    // Magnitude of INT64_MIN is one more than INT64_MAX.
+    const uint64_t limit = negative ? uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+    uint64_t value = 0;
+    for(; i < size; ++i)
+    {
+        const unsigned digit = static_cast<uint8_t>(data[i]) - '0';
+        if(digit > 9 || value > (limit - digit) / 10)
+        {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    result = negative ? -static_cast<int64_t>(value - 1) - 1 : static_cast<int64_t>(value);
+    return true;
+}
+
+/// strtod() in the "C" locale, on a value that is not NUL-terminated.
+inline bool parse_double_slow(const char* const data, const size_t size, double& result)
+{
+    static const locale_t c_locale = newlocale(LC_ALL_MASK, "C", static_cast<locale_t>(0));
+    // Values are short; only copy to the heap if we have to.
+    char buffer[128];
+    std::string long_value;
+    const char* terminated = buffer;
+    if(size < sizeof(buffer))
+    {
+        memcpy(buffer, data, size);
+        buffer[size] = '\0';
+    }
+    else
+    {
+        long_value.assign(data, size);
+        terminated = long_value.c_str();
+    }
+    char* end;
+    result = strtod_l(terminated, &end, c_locale);
+    return end == terminated + size;
+}
+
+/** Parse a decimal floating point number: [+-]digits[.digits][(e|E)[+-]digits].
+ *
+ * Either the integer or the fractional part may be empty, but not both.
+ *
+ * Most values are parsed exactly without strtod(): if the digits fit into a double's
+ * mantissa and the power of ten is at most 10^22 (also exact in a double), one
+ * multiplication or division gives the correctly rounded result. Other values fall back
+ * to strtod() in the "C" locale.
+ *
+ * Returns false if the value is not a number.
+ */
+inline bool parse_double(const char* const data, const size_t size, double& result)
+{
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    size_t i = 0;
+    const bool negative = size > 0 && data[0] == '-';
+    if(size > 0 && (data[0] == '-' || data[0] == '+'))
+    {
+        ++i;
+    }
+
+    // Up to 19 significant digits fit into mantissa.
+    uint64_t mantissa = 0;
+    int significant   = 0;
+    int exponent      = 0;
+    bool any_digits   = false;
+    bool too_many     = false;
+    bool fraction     = false;
+    for(; i < size; ++i)
+    {
+        const char c = data[i];
+        if(c == '.' && !fraction)
+        {
+            fraction = true;
+            continue;
+        }
+        const unsigned digit = static_cast<uint8_t>(c) - '0';
+        if(digit > 9)
+        {
+            break;
+        }
+        any_digits = true;
+        if(significant == 19)
+        {
+            // Too many digits for the fast path; just validate the rest.
+            too_many = true;
+            continue;
+        }
+        mantissa = mantissa * 10 + digit;
+        significant += mantissa != 0;
+        exponent    -= fraction;
+    }
+    if(!any_digits)
+    {
+        return false;
+    }
+    if(i < size && (data[i] == 'e' || data[i] == 'E'))
+    {
+        ++i;
+        const bool exponent_negative = i < size && data[i] == '-';
+        if(i < size && (data[i] == '-' || data[i] == '+'))
+        {
+            ++i;
+        }
+        if(i == size)
+        {
+            return false;
+        }
+        int explicit_exponent = 0;
+        for(; i < size; ++i)
+        {
+            const unsigned digit = static_cast<uint8_t>(data[i]) - '0';
+            if(digit > 9)
+            {
+                return false;
+            }
+            // Anything this big over/underflows anyway; leave it to strtod().
+            if(explicit_exponent < 100000)
+            {
+                explicit_exponent = explicit_exponent * 10 + digit;
+            }
+        }
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+    if(i != size)
+    {
+        return false;
+    }
+
+    if(too_many || mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22)
+    {
+        return parse_double_slow(data, size, result);
+    }
+    const double value = static_cast<double>(mantissa);
+    result = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+    result = negative ? -result : result;
+    return true;
+}
+
+/** Parse a bool: "yes", "true" or "1" is true, "no", "false" or "0" is false.
+ *
+ * Returns false if the value is none of these.
+ */
+inline bool parse_bool(const char* const data, const size_t size, bool& result)
+{
+    const auto is = [data, size](const char* const word) {
+        return size == strlen(word) && memcmp(data, word, size) == 0;
+    };
+    if(is("yes") || is("true") || is("1"))
+    {
+        result = true;
+        return true;
+    }
+    if(is("no") || is("false") || is("0"))
+    {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+#endif /* end of include guard: PARSE_VALUE_H_HNXBQELP */
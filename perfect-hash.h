@@ -0,0 +1,321 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef PERFECT_HASH_H_WJFKDUYC
+#define PERFECT_HASH_H_WJFKDUYC
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hash.h"
+
+/** Minimal perfect hash of a fixed set of keys (CHD-style "hash and displace").
+ *
+ * Maps each of n keys to its own slot in [0, n). Keys are split into buckets by hash;
+ * each bucket gets a pilot (d0, d1) chosen at build time so that its keys land in free
+ * slots at (f1 + d0 * f2 + d1) % n, where f1 and f2 are derived from the key hash. The
+ * biggest buckets are placed first, while the table is still empty; single-key
+ * buckets are placed directly in the remaining free slots.
+ *
+ * A lookup is one hash, one pilot read and one slot read. Each slot stores the entry
+ * index and a 32-bit fingerprint of the key, so most keys that are not in the set are
+ * rejected without comparing any keys.
+ */
+class PerfectHash
+{
+private:
+    struct Slot
+    {
+        uint32_t index;
+        uint32_t fingerprint;
+    };
+
+    // Average number of keys per bucket. Fewer buckets use less memory but take longer
+    // to build: the last multi-key buckets must fit into an almost full table. 2 is the
+    // sweet spot on huge.cfg (3 takes twice as long to build, 4 takes 4x as long).
+    static const size_t KEYS_PER_BUCKET = 2;
+
+    // Number of d0 values to try before giving up on a seed.
+    static const uint64_t MAX_D0 = 256;
+
+    // Pilots of buckets: d0 in the upper 32 bits, d1 in the lower 32 bits.
+    std::vector<uint64_t> pilots;
+
+    std::vector<Slot> slots;
+
+    uint64_t seed = 0;
+
+    /// Map a 32-bit value to [0, range) without division.
+    static uint32_t fast_range(const uint32_t value, const uint32_t range)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(value) * range) >> 32);
+    }
+
+    /// Hash values of a key used by the perfect hash.
+    struct KeyHash
+    {
+        uint32_t bucket;
+        uint32_t f1;
+        uint32_t f2;
+        uint32_t fingerprint;
+    };
+
+    /// Compute the hash values of a key, given its 64-bit hash.
+    KeyHash key_hash(const uint64_t hash) const
+    {
+        const uint64_t other = hash_mix(hash ^ 0x9E3779B97F4A7C15ULL);
+        const uint32_t n = static_cast<uint32_t>(slots.size());
+        KeyHash result;
+        result.bucket      = fast_range(static_cast<uint32_t>(hash >> 32),
+                                        static_cast<uint32_t>(pilots.size()));
+        result.f1          = fast_range(static_cast<uint32_t>(hash), n);
+        result.f2          = fast_range(static_cast<uint32_t>(other), n);
+        result.fingerprint = static_cast<uint32_t>(other >> 32);
+        return result;
+    }
+
+    /// Slot of a key with specified pilot.
+    uint32_t position(const KeyHash& kh, const uint64_t pilot) const
+    {
+        const uint64_t d0 = pilot >> 32;
+        const uint64_t d1 = pilot & 0xFFFFFFFF;
+        return static_cast<uint32_t>((kh.f1 + d0 * kh.f2 + d1) % slots.size());
+    }
+
+    /// Try to build with current seed. Returns false if some bucket can't be placed.
+    template<typename KeyOf>
+    bool try_build(const size_t count, const KeyOf& key_of)
+    {
+        std::vector<KeyHash> hashes(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            const auto key = key_of(i);
+            hashes[i] = key_hash(hash_bytes(key.ptr(), key.size(), seed));
+        }
+
+        // Group keys by bucket (counting sort).
+        const size_t bucket_count = pilots.size();
+        std::vector<uint32_t> bucket_starts(bucket_count + 1, 0);
+        for(const auto& kh: hashes)
+        {
+            ++bucket_starts[kh.bucket + 1];
+        }
+        for(size_t b = 0; b < bucket_count; ++b)
+        {
+            bucket_starts[b + 1] += bucket_starts[b];
+        }
+        std::vector<uint32_t> bucket_keys(count);
+        {
+            std::vector<uint32_t> fill(bucket_starts.begin(), bucket_starts.end() - 1);
+            for(size_t i = 0; i < count; ++i)
+            {
+                bucket_keys[fill[hashes[i].bucket]++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        // Place biggest buckets first.
+        std::vector<uint32_t> order(bucket_count);
+        for(size_t b = 0; b < bucket_count; ++b)
+        {
+            order[b] = static_cast<uint32_t>(b);
+        }
+        const auto bucket_size = [&bucket_starts](const uint32_t b) {
+            return bucket_starts[b + 1] - bucket_starts[b];
+        };
+        std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) {
+            return bucket_size(a) > bucket_size(b);
+        });
+
+        std::vector<char> taken(count, false);
+        std::vector<uint32_t> positions;
+        // Next possibly free slot for single-key buckets.
+        size_t next_free = 0;
+        for(const uint32_t b: order)
+        {
+            const uint32_t* const keys = bucket_keys.data() + bucket_starts[b];
+            const size_t size = bucket_size(b);
+            if(size == 0)
+            {
+                // Buckets are sorted by size, so all remaining buckets are empty.
+                break;
+            }
+            if(size == 1)
+            {
+                // Choose d1 to put the key straight into a free slot.
+                while(taken[next_free])
+                {
+                    ++next_free;
+                }
+                const KeyHash& kh = hashes[keys[0]];
+                pilots[b] = (next_free + count - kh.f1) % count;
+                taken[next_free] = true;
+                slots[next_free].index       = keys[0];
+                slots[next_free].fingerprint = kh.fingerprint;
+                continue;
+            }
+
+            // Keys with the same f1 and f2 always collide; we need a different seed.
+            for(size_t k = 1; k < size; ++k)
+            {
+                for(size_t l = 0; l < k; ++l)
+                {
+                    const KeyHash& a = hashes[keys[k]];
+                    const KeyHash& o = hashes[keys[l]];
+                    if(a.f1 == o.f1 && a.f2 == o.f2)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            bool placed = false;
+            for(uint64_t d0 = 0; d0 < MAX_D0 && !placed; ++d0)
+            {
+                for(uint64_t d1 = 0; d1 < count && !placed; ++d1)
+                {
+                    const uint64_t pilot = (d0 << 32) | d1;
+                    positions.clear();
+                    for(size_t k = 0; k < size; ++k)
+                    {
+                        const uint32_t pos = position(hashes[keys[k]], pilot);
+                        if(taken[pos] ||
+                           std::find(positions.begin(), positions.end(), pos) != positions.end())
+                        {
+                            break;
+                        }
+                        positions.push_back(pos);
+                    }
+                    if(positions.size() != size)
+                    {
+                        continue;
+                    }
+                    placed    = true;
+                    pilots[b] = pilot;
+                    for(size_t k = 0; k < size; ++k)
+                    {
+                        taken[positions[k]] = true;
+                        slots[positions[k]].index       = keys[k];
+                        slots[positions[k]].fingerprint = hashes[keys[k]].fingerprint;
+                    }
+                }
+            }
+            if(!placed)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    /// Returned by find() if there is no matching entry.
+    static const uint32_t NOT_FOUND = UINT32_MAX;
+
+    /// Maximum number of keys passed to candidates() at once.
+    static const size_t MAX_CANDIDATES = 32;
+
+    /** Build the perfect hash.
+     *
+     * count  = Number of keys. Keys must be unique.
+     * key_of = key_of(i) must return key i as a slice (something with ptr() and size()).
+     */
+    template<typename KeyOf>
+    void build(const size_t count, const KeyOf& key_of)
+    {
+        if(count == 0)
+        {
+            pilots.clear();
+            slots.clear();
+            return;
+        }
+        for(seed = 0;; ++seed)
+        {
+            pilots.assign((count + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET, 0);
+            slots.assign(count, Slot());
+            if(try_build(count, key_of))
+            {
+                return;
+            }
+        }
+    }
+
+    /// Has the perfect hash been built?
+    bool empty() const { return slots.empty(); }
+
+    /// Size of the perfect hash in bytes.
+    size_t bytes() const
+    {
+        return pilots.size() * sizeof(uint64_t) + slots.size() * sizeof(Slot);
+    }
+
+    /** Candidate entries for count keys.
+     *
+     * Used for batched lookups: prefetches pilots of all keys, then slots of all keys,
+     * then reads the slots, so cache misses of different keys overlap.
+     *
+     * The caller must check that the candidate's key matches (if it doesn't, the key is
+     * not in the set).
+     *
+     * keys       = Keys to look for (things with ptr() and size()).
+     * count      = Number of keys. At most MAX_CANDIDATES.
+     * candidates = Candidate entry indices (or NOT_FOUND) are written here.
+     */
+    template<typename Key>
+    void candidates(const Key* const keys, const size_t count, uint32_t* const candidates) const
+    {
+        if(slots.empty())
+        {
+            std::fill(candidates, candidates + count, NOT_FOUND);
+            return;
+        }
+        assert(count <= MAX_CANDIDATES);
+        KeyHash hashes[MAX_CANDIDATES];
+        // Use candidates to store slot positions until we read the slots.
+        for(size_t i = 0; i < count; ++i)
+        {
+            hashes[i] = key_hash(hash_bytes(keys[i].ptr(), keys[i].size(), seed));
+            __builtin_prefetch(&pilots[hashes[i].bucket]);
+        }
+        for(size_t i = 0; i < count; ++i)
+        {
+            candidates[i] = position(hashes[i], pilots[hashes[i].bucket]);
+            __builtin_prefetch(&slots[candidates[i]]);
+        }
+        for(size_t i = 0; i < count; ++i)
+        {
+            const Slot& slot = slots[candidates[i]];
+            candidates[i] = slot.fingerprint == hashes[i].fingerprint ? slot.index : NOT_FOUND;
+        }
+    }
+
+    /** Find a key.
+     *
+     * key     = Key to find (something with ptr() and size()).
+     * matches = matches(i) must return true if entry i has the key we're looking for.
+     *           Called at most once, and only if the fingerprint matches.
+     *
+     * Returns the index of the entry, or NOT_FOUND.
+     */
+    template<typename Key, typename Matches>
+    uint32_t find(const Key& key, const Matches& matches) const
+    {
+        if(slots.empty())
+        {
+            return NOT_FOUND;
+        }
+        const KeyHash kh = key_hash(hash_bytes(key.ptr(), key.size(), seed));
+        const Slot& slot = slots[position(kh, pilots[kh.bucket])];
+        if(slot.fingerprint != kh.fingerprint || !matches(slot.index))
+        {
+            return NOT_FOUND;
+        }
+        return slot.index;
+    }
+};
+
+#endif /* end of include guard: PERFECT_HASH_H_WJFKDUYC */
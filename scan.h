@@ -0,0 +1,500 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef SCAN_H_MTGOXKVA
+#define SCAN_H_MTGOXKVA
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/** Vectorized line scanner for CFG files.
+ *
+ * Instead of looking for newlines, comments, separators and spaces one character at a
+ * time, we classify a 64-byte window of text at once into four bitmasks (bit i set if
+ * byte i is of that class). Most lines fit into one window, so a line is parsed with a
+ * few bit operations: the first newline/comment bit ends the line, the first separator
+ * bit splits key from value and the lowest/highest non-space bits trim them. A trimmed
+ * line with no separator that starts with '[' and ends with ']' is a section header; a
+ * line with a separator is always an entry (e.g. "[x]=[y]" is key "[x]", value "[y]").
+ *
+ * Windows are classified by plain C++ (SCALAR), SSE2 (16 bytes at a time, always there
+ * on x86-64) or AVX2 (32 bytes at a time, used if the CPU supports it). All produce the
+ * same masks, so all produce the same results.
+ */
+
+
+/// Position and length of a string in a text.
+struct Span
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+/// Instruction sets the scanner can use.
+enum class Isa
+{
+    /// Best available on this CPU.
+    AUTO,
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+/// Size of a window classified at once.
+const size_t SCAN_WINDOW = 64;
+
+/// Classes of characters in a window (bit i describes byte i).
+struct WindowMasks
+{
+    // '\r' and '\n'
+    uint64_t newline;
+    // ';' and '#'
+    uint64_t comment;
+    // '='
+    uint64_t separator;
+    // ' ' and '\t'
+    uint64_t space;
+};
+
+// Character classes for the scalar classifier. Same characters as SPACES, COMMENTS and
+// SEPARATORS in cfg.h.
+enum : uint8_t
+{
+    CLASS_NEWLINE   = 1,
+    CLASS_COMMENT   = 2,
+    CLASS_SEPARATOR = 4,
+    CLASS_SPACE     = 8
+};
+
+/// Builds the lookup table for the scalar classifier.
+struct ClassTable
+{
+    uint8_t table[256];
+
+    ClassTable()
+    {
+        memset(table, 0, sizeof(table));
+        table[static_cast<uint8_t>('\r')] = CLASS_NEWLINE;
+        table[static_cast<uint8_t>('\n')] = CLASS_NEWLINE;
+        table[static_cast<uint8_t>(';')]  = CLASS_COMMENT;
+        table[static_cast<uint8_t>('#')]  = CLASS_COMMENT;
+        table[static_cast<uint8_t>('=')]  = CLASS_SEPARATOR;
+        table[static_cast<uint8_t>(' ')]  = CLASS_SPACE;
+        table[static_cast<uint8_t>('\t')] = CLASS_SPACE;
+    }
+};
+
+const ClassTable CLASS_TABLE;
+
+/// Classifies a window one byte at a time.
+struct ScalarClassifier
+{
+    static inline void classify(const char* const window, WindowMasks& masks)
+    {
+        masks.newline = masks.comment = masks.separator = masks.space = 0;
+        for(size_t i = 0; i < SCAN_WINDOW; ++i)
+        {
+            const uint8_t c = CLASS_TABLE.table[static_cast<uint8_t>(window[i])];
+            const uint64_t bit = uint64_t(1) << i;
+            masks.newline   |= (c & CLASS_NEWLINE)   ? bit : 0;
+            masks.comment   |= (c & CLASS_COMMENT)   ? bit : 0;
+            masks.separator |= (c & CLASS_SEPARATOR) ? bit : 0;
+            masks.space     |= (c & CLASS_SPACE)     ? bit : 0;
+        }
+    }
+};
+
+#ifdef SCAN_X86
+
+/// Classifies a window 16 bytes at a time with SSE2.
+struct Sse2Classifier
+{
+    static inline void classify(const char* const window, WindowMasks& masks)
+    {
+        masks.newline = masks.comment = masks.separator = masks.space = 0;
+        for(size_t i = 0; i < SCAN_WINDOW; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i));
+            const __m128i newline =
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+            const __m128i comment =
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(';')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+            const __m128i separator = _mm_cmpeq_epi8(v, _mm_set1_epi8('='));
+            const __m128i space =
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+            // movemask gives us 16 bits, one per byte.
+            masks.newline   |= uint64_t(uint16_t(_mm_movemask_epi8(newline)))   << i;
+            masks.comment   |= uint64_t(uint16_t(_mm_movemask_epi8(comment)))   << i;
+            masks.separator |= uint64_t(uint16_t(_mm_movemask_epi8(separator))) << i;
+            masks.space     |= uint64_t(uint16_t(_mm_movemask_epi8(space)))     << i;
+        }
+    }
+};
+
+/// Classifies a window 32 bytes at a time with AVX2.
+///
+/// Only inlined into functions compiled with target("avx2").
+struct Avx2Classifier
+{
+    __attribute__((target("avx2")))
+    static inline void classify(const char* const window, WindowMasks& masks)
+    {
+        masks.newline = masks.comment = masks.separator = masks.space = 0;
+        for(size_t i = 0; i < SCAN_WINDOW; i += 32)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(window + i));
+            const __m256i newline =
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+            const __m256i comment =
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+            const __m256i separator = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('='));
+            const __m256i space =
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+            masks.newline   |= uint64_t(uint32_t(_mm256_movemask_epi8(newline)))   << i;
+            masks.comment   |= uint64_t(uint32_t(_mm256_movemask_epi8(comment)))   << i;
+            masks.separator |= uint64_t(uint32_t(_mm256_movemask_epi8(separator))) << i;
+            masks.space     |= uint64_t(uint32_t(_mm256_movemask_epi8(space)))     << i;
+        }
+    }
+};
+
+#endif
+
+/// Index of the lowest set bit. mask must not be 0.
+inline unsigned lowest_bit(const uint64_t mask) { return __builtin_ctzll(mask); }
+
+/// Index of the highest set bit. mask must not be 0.
+inline unsigned highest_bit(const uint64_t mask) { return 63 - __builtin_clzll(mask); }
+
+/// Mask with all bits below bit set.
+inline uint64_t bits_below(const unsigned bit)
+{
+    return bit >= 64 ? ~uint64_t(0) : (uint64_t(1) << bit) - 1;
+}
+
+/// Result of scanning one line.
+enum class LineKind
+{
+    /// Empty, blank or comment-only line.
+    BLANK,
+    /// A key-value pair.
+    ENTRY,
+    /// A [section] header.
+    SECTION,
+    /// Non-empty line with no separator that is not a [section] header.
+    ERROR
+};
+
+/** Scan one line one byte at a time, the way cfg5 used to parse lines.
+ *
+ * Used for lines that don't fit into a window. Gives the same results as the window
+ * scanner.
+ *
+ * data/size = Entire text.
+ * pos       = Start of the line. Set to the start of the next line.
+ * key/value = Set to the key/value if the line is an entry.
+ *             If the line is a section header, key is set to the (trimmed) section name
+ *             and value to the (trimmed) line.
+ *             If the line is an error, key is set to the (trimmed) line.
+ */
+inline LineKind scan_line_scalar(const char* const data, const size_t size, size_t& pos,
+                                 Span& key, Span& value)
+{
+    const uint8_t* const table = CLASS_TABLE.table;
+    const auto is = [&](const size_t i, const uint8_t cls) {
+        return (table[static_cast<uint8_t>(data[i])] & cls) != 0;
+    };
+
+    size_t end = pos;
+    while(end < size && !is(end, CLASS_NEWLINE))
+    {
+        ++end;
+    }
+    size_t content_end = pos;
+    while(content_end < end && !is(content_end, CLASS_COMMENT))
+    {
+        ++content_end;
+    }
+    size_t begin = pos;
+    pos = end + 1;
+
+    // Trim
+    while(begin < content_end && is(begin, CLASS_SPACE))
+    {
+        ++begin;
+    }
+    while(content_end > begin && is(content_end - 1, CLASS_SPACE))
+    {
+        --content_end;
+    }
+    if(begin == content_end)
+    {
+        return LineKind::BLANK;
+    }
+
+    size_t separator = begin;
+    while(separator < content_end && !is(separator, CLASS_SEPARATOR))
+    {
+        ++separator;
+    }
+    if(separator == content_end)
+    {
+        if(data[begin] != '[' || data[content_end - 1] != ']')
+        {
+            key.offset = static_cast<uint32_t>(begin);
+            key.length = static_cast<uint32_t>(content_end - begin);
+            return LineKind::ERROR;
+        }
+        size_t name_begin = begin + 1;
+        size_t name_end   = content_end - 1;
+        while(name_begin < name_end && is(name_begin, CLASS_SPACE))
+        {
+            ++name_begin;
+        }
+        while(name_end > name_begin && is(name_end - 1, CLASS_SPACE))
+        {
+            --name_end;
+        }
+        key.offset   = static_cast<uint32_t>(name_begin);
+        key.length   = static_cast<uint32_t>(name_end - name_begin);
+        value.offset = static_cast<uint32_t>(begin);
+        value.length = static_cast<uint32_t>(content_end - begin);
+        return LineKind::SECTION;
+    }
+
+    // The line is trimmed, so we only need to trim the inner sides of key and value.
+    size_t key_end = separator;
+    while(key_end > begin && is(key_end - 1, CLASS_SPACE))
+    {
+        --key_end;
+    }
+    size_t value_begin = separator + 1;
+    while(value_begin < content_end && is(value_begin, CLASS_SPACE))
+    {
+        ++value_begin;
+    }
+    key.offset   = static_cast<uint32_t>(begin);
+    key.length   = static_cast<uint32_t>(key_end - begin);
+    value.offset = static_cast<uint32_t>(value_begin);
+    value.length = static_cast<uint32_t>(content_end - value_begin);
+    return LineKind::ENTRY;
+}
+
+/** Scan one line using a classified window.
+ *
+ * Parameters are the same as for scan_line_scalar().
+ */
+template<typename Classifier>
+__attribute__((always_inline))
+inline LineKind scan_line(const char* const data, const size_t size, size_t& pos,
+                          Span& key, Span& value)
+{
+    WindowMasks masks;
+    if(pos + SCAN_WINDOW <= size)
+    {
+        Classifier::classify(data + pos, masks);
+    }
+    else
+    {
+        // Near the end of text; pad with newlines so the last line is terminated.
+        char window[SCAN_WINDOW];
+        memset(window, '\n', SCAN_WINDOW);
+        memcpy(window, data + pos, size - pos);
+        Classifier::classify(window, masks);
+    }
+
+    const uint64_t stop = masks.newline | masks.comment;
+    if(stop == 0)
+    {
+        // Line longer than the window.
+        return scan_line_scalar(data, size, pos, key, value);
+    }
+    const unsigned content_end = lowest_bit(stop);
+    const size_t line_start    = pos;
+    if(masks.newline & (uint64_t(1) << content_end))
+    {
+        pos += content_end + 1;
+    }
+    else
+    {
+        // Comment; skip to the end of line.
+        const uint64_t newline_after = masks.newline & ~bits_below(content_end);
+        if(newline_after == 0)
+        {
+            // The comment continues past the window.
+            pos += content_end;
+            while(pos < size && data[pos] != '\n' && data[pos] != '\r')
+            {
+                ++pos;
+            }
+            ++pos;
+        }
+        else
+        {
+            pos += lowest_bit(newline_after) + 1;
+        }
+    }
+
+    const uint64_t content  = bits_below(content_end);
+    const uint64_t nonspace = ~masks.space & content;
+    if(nonspace == 0)
+    {
+        return LineKind::BLANK;
+    }
+    const unsigned begin = lowest_bit(nonspace);
+    const unsigned end   = highest_bit(nonspace) + 1;
+    const uint64_t separators = masks.separator & content;
+    if(separators == 0)
+    {
+        if(data[line_start + begin] != '[' || data[line_start + end - 1] != ']')
+        {
+            key.offset = static_cast<uint32_t>(line_start + begin);
+            key.length = end - begin;
+            return LineKind::ERROR;
+        }
+        const uint64_t name_bits = nonspace & bits_below(end - 1) & ~bits_below(begin + 1);
+        // An empty name points to the ']' like it would with scan_line_scalar().
+        const unsigned name_begin = name_bits == 0 ? end - 1 : lowest_bit(name_bits);
+        const unsigned name_end   = name_bits == 0 ? end - 1 : highest_bit(name_bits) + 1;
+        key.offset   = static_cast<uint32_t>(line_start + name_begin);
+        key.length   = name_end - name_begin;
+        value.offset = static_cast<uint32_t>(line_start + begin);
+        value.length = end - begin;
+        return LineKind::SECTION;
+    }
+
+    const unsigned separator = lowest_bit(separators);
+    // Empty key/value point to the trimmed line like they would with scan_line_scalar().
+    const uint64_t key_bits   = nonspace & bits_below(separator);
+    const uint64_t value_bits = nonspace & ~bits_below(separator + 1);
+    const unsigned key_end    = key_bits == 0 ? begin : highest_bit(key_bits) + 1;
+    const unsigned value_begin = value_bits == 0 ? separator + 1 : lowest_bit(value_bits);
+    key.offset   = static_cast<uint32_t>(line_start + begin);
+    key.length   = key_end - begin;
+    value.offset = static_cast<uint32_t>(line_start + value_begin);
+    value.length = value_bits == 0 ? 0 : end - value_begin;
+    return LineKind::ENTRY;
+}
+
+/// Scan all lines of text. See scan_lines().
+template<typename Classifier, typename Sink, typename SectionSink>
+__attribute__((always_inline))
+inline bool scan_lines_with(const char* const data, const size_t size, Sink& sink,
+                            SectionSink& section_sink, Span& error)
+{
+    Span key, value;
+    for(size_t pos = 0; pos < size;)
+    {
+        switch(scan_line<Classifier>(data, size, pos, key, value))
+        {
+            case LineKind::BLANK: break;
+            case LineKind::ENTRY: sink(key, value); break;
+            case LineKind::SECTION:
+                if(!section_sink(key))
+                {
+                    error = value;
+                    return false;
+                }
+                break;
+            case LineKind::ERROR: error = key; return false;
+        }
+    }
+    return true;
+}
+
+template<typename Sink, typename SectionSink>
+bool scan_lines_scalar(const char* const data, const size_t size, Sink& sink,
+                       SectionSink& section_sink, Span& error)
+{
+    return scan_lines_with<ScalarClassifier>(data, size, sink, section_sink, error);
+}
+
+#ifdef SCAN_X86
+
+template<typename Sink, typename SectionSink>
+bool scan_lines_sse2(const char* const data, const size_t size, Sink& sink,
+                       SectionSink& section_sink, Span& error)
+{
+    return scan_lines_with<Sse2Classifier>(data, size, sink, section_sink, error);
+}
+
+template<typename Sink, typename SectionSink>
+__attribute__((target("avx2")))
+bool scan_lines_avx2(const char* const data, const size_t size, Sink& sink,
+                       SectionSink& section_sink, Span& error)
+{
+    return scan_lines_with<Avx2Classifier>(data, size, sink, section_sink, error);
+}
+
+#endif
+
+/// Get the instruction set that Isa::AUTO resolves to on this CPU.
+inline Isa best_isa()
+{
+#ifdef SCAN_X86
+    static const Isa best = __builtin_cpu_supports("avx2") ? Isa::AVX2 : Isa::SSE2;
+    return best;
+#else
+    return Isa::SCALAR;
+#endif
+}
+
+/** Scan a CFG text into key/value spans.
+ *
+ * data/size    = Text to scan. Offsets must fit into 32 bits.
+ * sink         = Called as sink(key, value) for every key-value pair, in file order.
+ *                Both key and value are trimmed; comments and blank lines are skipped.
+ * section_sink = Called as section_sink(name) for every [section] header, in file order
+ *                (interleaved with sink() calls). The name is trimmed. Returns false to
+ *                treat the header as an error.
+ * error        = If a non-empty line has no separator (and is not a [section] header),
+ *                or section_sink() returns false, set to that line (trimmed).
+ * isa          = Instruction set to use. Falls back to SCALAR if not supported here.
+ *
+ * Returns false if a line was an error.
+ */
+template<typename Sink, typename SectionSink>
+bool scan_lines(const char* const data, const size_t size, Sink& sink,
+                SectionSink& section_sink, Span& error, Isa isa = Isa::AUTO)
+{
+    if(isa == Isa::AUTO)
+    {
+        isa = best_isa();
+    }
+#ifdef SCAN_X86
+    if(isa == Isa::AVX2 && __builtin_cpu_supports("avx2"))
+    {
+        return scan_lines_avx2(data, size, sink, section_sink, error);
+    }
+    if(isa == Isa::SSE2 || isa == Isa::AVX2)
+    {
+        return scan_lines_sse2(data, size, sink, section_sink, error);
+    }
+#endif
+    return scan_lines_scalar(data, size, sink, section_sink, error);
+}
+
+/// Scan a CFG text with no sections; [section] headers are errors. See scan_lines() above.
+template<typename Sink>
+bool scan_lines(const char* const data, const size_t size, Sink& sink, Span& error,
+                Isa isa = Isa::AUTO)
+{
+    const auto no_sections = [](const Span) { return false; };
+    return scan_lines(data, size, sink, no_sections, error, isa);
+}
+
+#endif /* end of include guard: SCAN_H_MTGOXKVA */
@@ -0,0 +1,197 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef SNAPSHOT_H_TMWQKDZA
+#define SNAPSHOT_H_TMWQKDZA
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "hash.h"
+
+/** Compiled CFG snapshots: a parsed CFG saved to a file that can be mapped and used
+ * without parsing. See CFG::save_snapshot(), CFG::load_snapshot() and cfgc.cpp.
+ *
+ * A snapshot is a SnapshotHeader followed by the string heap (section names, keys and
+ * values), sorted entries, sections and the hash index of the unnamed section, each
+ * aligned to SNAPSHOT_ALIGN. Entries and sections are stored exactly as they are in
+ * memory, so loading is just mapping the file and pointing into it. The price is that
+ * a snapshot only works on machines with the same byte order and SNAPSHOT_VERSION.
+ *
+ * The header records the size and modification time of the source text, so a snapshot
+ * of a file that has changed since is rejected instead of silently used.
+ */
+
+
+/// Increment on any change of the header, Entry, CFG::Section or HashIndex layout.
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+/// Written to the header as a number; reads differently with a different byte order.
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+/// Parts of a snapshot are aligned to this (a cache line).
+static const size_t SNAPSHOT_ALIGN = 64;
+
+/// Size and modification time of a source file, to detect stale snapshots.
+struct SourceStamp
+{
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+
+    bool operator==(const SourceStamp& rhs) const
+    {
+        return size == rhs.size && mtime_sec == rhs.mtime_sec && mtime_nsec == rhs.mtime_nsec;
+    }
+};
+
+/// Header at the start of a snapshot file. All offsets are from the start of the file.
+struct SnapshotHeader
+{
+    // "CFGSNAP" and a '\0'.
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    // The source text when the snapshot was compiled.
+    SourceStamp source;
+    // Size of the whole snapshot file.
+    uint64_t file_size;
+    // hash_bytes() of everything after the header.
+    uint64_t checksum;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+    uint64_t entries_offset;
+    uint64_t entries_size;
+    uint64_t sections_offset;
+    uint64_t sections_size;
+    uint64_t hash_offset;
+    uint64_t hash_size;
+};
+
+/** Get the SourceStamp of a file.
+ *
+ * Stamp the source before reading it: if it changes while being read, its stamp changes
+ * too and the snapshot is stale from the start.
+ *
+ * Returns false if the file doesn't exist or can't be accessed.
+ */
+inline bool source_stamp(const std::string& filename, SourceStamp& stamp)
+{
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    stamp.size       = static_cast<uint64_t>(st.st_size);
+    stamp.mtime_sec  = static_cast<int64_t>(st.st_mtim.tv_sec);
+    stamp.mtime_nsec = static_cast<int64_t>(st.st_mtim.tv_nsec);
+    return true;
+}
+
+/// Make a header for a snapshot of source. Offsets, sizes and checksum are left at 0.
+inline SnapshotHeader snapshot_header(const SourceStamp& source)
+{
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CFGSNAP", 8);
+    header.version    = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.source     = source;
+    return header;
+}
+
+/// Append size bytes of data to a snapshot image at an aligned offset. Returns the offset.
+inline uint64_t snapshot_append(std::vector<char>& image, const void* const data,
+                                const size_t size)
+{
+    image.resize((image.size() + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN, 0);
+    const uint64_t offset = image.size();
+    image.insert(image.end(), static_cast<const char*>(data),
+                 static_cast<const char*>(data) + size);
+    return offset;
+}
+
+/** Finish a snapshot image (fill in file size and checksum) and write it to a file.
+ *
+ * image  = Space for the header followed by parts added by snapshot_append().
+ * header = Header with offsets and sizes of the parts.
+ *
+ * Writes to a temporary file and renames it, so processes that have the old snapshot
+ * mapped keep seeing the old one, and nobody ever sees a half-written snapshot.
+ *
+ * Returns false if the file could not be written.
+ */
+inline bool write_snapshot(const std::string& filename, SnapshotHeader header,
+                           std::vector<char>& image)
+{
+    header.file_size = image.size();
+    header.checksum  = hash_bytes(image.data() + sizeof(header),
+                                  image.size() - sizeof(header));
+    memcpy(image.data(), &header, sizeof(header));
+
+    const std::string temp = filename + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file.write(image.data(), image.size());
+        if(!file.good())
+        {
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    return std::rename(temp.c_str(), filename.c_str()) == 0;
+}
+
+/** Read and validate the header of a snapshot.
+ *
+ * data/size = The whole snapshot file.
+ * source    = Current stamp of the source text.
+ * checksum  = Verify the checksum? This reads the whole file, which takes much longer
+ *             than everything else a load does.
+ * header    = The header is written here.
+ *
+ * Returns false if the snapshot is not a valid snapshot of this version and byte order,
+ * if any part is out of bounds or misaligned, if the checksum doesn't match, or if it is
+ * stale (source has changed since the snapshot was compiled).
+ */
+inline bool read_snapshot_header(const char* const data, const size_t size,
+                                 const SourceStamp& source, const bool checksum,
+                                 SnapshotHeader& header)
+{
+    if(size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, "CFGSNAP", 8) != 0 || header.version != SNAPSHOT_VERSION ||
+       header.byte_order != SNAPSHOT_BYTE_ORDER || header.file_size != size ||
+       !(header.source == source))
+    {
+        return false;
+    }
+    const auto in_bounds = [size](const uint64_t offset, const uint64_t part_size) {
+        return offset % SNAPSHOT_ALIGN == 0 && offset >= sizeof(SnapshotHeader) &&
+               offset <= size && part_size <= size - offset;
+    };
+    if(!in_bounds(header.heap_offset, header.heap_size) ||
+       !in_bounds(header.entries_offset, header.entries_size) ||
+       !in_bounds(header.sections_offset, header.sections_size) ||
+       !in_bounds(header.hash_offset, header.hash_size))
+    {
+        return false;
+    }
+    // Checked last: it's the only check that reads the whole file.
+    return !checksum ||
+           header.checksum == hash_bytes(data + sizeof(header), size - sizeof(header));
+}
+
+#endif /* end of include guard: SNAPSHOT_H_TMWQKDZA */
@@ -0,0 +1,110 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef SPSC_RING_H_TKVZMPQE
+#define SPSC_RING_H_TKVZMPQE
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** A fixed-size lock-free queue of one producer thread and one consumer thread.
+ *
+ * Never blocks or allocates: push() fails if the ring is full. The producer and the
+ * consumer each write only their own index, and the indices are on different cache
+ * lines, so they don't fight over a cache line on every item. The producer also keeps a
+ * copy of the consumer's index and only reads the real one when the ring seems full.
+ *
+ * CAPACITY must be a power of two. Items are copied, so T should be small and trivial.
+ */
+template<typename T, size_t CAPACITY>
+class SpscRing
+{
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+                  "SpscRing capacity must be a power of two");
+
+private:
+    // Index of the next item to push. Written by the producer.
+    std::atomic<uint64_t> head;
+    // The producer's copy of tail.
+    uint64_t cached_tail;
+    char padding0[64 - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+    // Index of the next item to pop. Written by the consumer.
+    std::atomic<uint64_t> tail;
+    char padding1[64 - sizeof(std::atomic<uint64_t>)];
+
+    T items[CAPACITY];
+
+public:
+    SpscRing()
+        : head(0)
+        , cached_tail(0)
+        , tail(0)
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /// Add an item. Producer only. Returns false (and drops the item) if the ring is full.
+    bool push(const T& item)
+    {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if(h - cached_tail == CAPACITY)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(h - cached_tail == CAPACITY)
+            {
+                return false;
+            }
+        }
+        items[h & (CAPACITY - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Take all items pushed so far. Consumer only.
+     *
+     * consume(const T* items, size_t count) is called once or twice (if the items wrap
+     * around the end of the ring) with items in the order they were pushed. The items
+     * may be overwritten once consume() returns.
+     *
+     * Returns the number of items taken.
+     */
+    template<typename Consume>
+    size_t drain(const Consume& consume)
+    {
+        const uint64_t t = tail.load(std::memory_order_relaxed);
+        const uint64_t h = head.load(std::memory_order_acquire);
+        if(h == t)
+        {
+            return 0;
+        }
+        const size_t first = t & (CAPACITY - 1);
+        const size_t count = static_cast<size_t>(h - t);
+        const size_t until_end = CAPACITY - first;
+        if(count <= until_end)
+        {
+            consume(items + first, count);
+        }
+        else
+        {
+            consume(items + first, until_end);
+            consume(items, count - until_end);
+        }
+        tail.store(h, std::memory_order_release);
+        return count;
+    }
+
+    /// Number of items in the ring. Only a snapshot if the other thread is running.
+    size_t size() const
+    {
+        return static_cast<size_t>(head.load(std::memory_order_acquire) -
+                                   tail.load(std::memory_order_acquire));
+    }
+};
+
+#endif /* end of include guard: SPSC_RING_H_TKVZMPQE */
@@ -0,0 +1,245 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef STRING_SORT_H_QTRMBHVA
+#define STRING_SORT_H_QTRMBHVA
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// For key_prefix()
+#include "eytzinger.h"
+
+/** MSD radix sort of strings that finds duplicates while sorting.
+ *
+ * A comparison sort compares whole keys at every step, even though after a few steps
+ * all keys that are still being compared to each other share their first bytes. MSD
+ * radix sort distributes keys into 256 buckets by their first byte, then each bucket by
+ * the second byte, and so on; it looks at every byte at most once and never compares
+ * keys. Small buckets are finished with insertion sort.
+ *
+ * The first 8 bytes come from the key prefix (see key_prefix()) stored in the elements,
+ * so the first levels don't touch the text at all.
+ *
+ * Keys that end at the current byte go to a bucket before all others (they're prefixes
+ * of the other keys). All keys in that bucket have the same bytes and the same length,
+ * so if there's more than one, they are duplicates. That way we find duplicates without
+ * a separate pass over sorted keys.
+ */
+template<typename T, typename KeyOf, typename PrefixOf>
+class StringSorter
+{
+private:
+    // Buckets this small are sorted with insertion sort.
+    static const size_t INSERTION_SORT_MAX = 32;
+
+    // Bucket 0 is for keys that have ended, bucket 1 + b for byte b.
+    static const size_t BUCKETS = 257;
+
+    const KeyOf& key_of;
+    const PrefixOf& prefix_of;
+
+    // Scratch space for distributing elements into buckets.
+    std::vector<T> scratch;
+
+    bool found_duplicate = false;
+    T duplicate;
+
+    /// Keys with equal first pos bytes, still to be sorted.
+    struct Range
+    {
+        T* data;
+        size_t count;
+        size_t pos;
+    };
+
+    // Ranges left to sort. An explicit stack instead of recursion: keys sharing thousands
+    // of bytes would need thousands of levels.
+    std::vector<Range> work;
+
+    // Bucket starts and fill positions of the range being distributed.
+    size_t starts[BUCKETS + 1];
+    size_t fill[BUCKETS];
+
+    /// Bucket of an element by byte at pos of its key.
+    size_t bucket(const T& element, const size_t pos) const
+    {
+        const auto key = key_of(element);
+        if(pos >= key.size())
+        {
+            return 0;
+        }
+        if(pos < 8)
+        {
+            return 1 + ((prefix_of(element) >> (56 - 8 * pos)) & 0xFF);
+        }
+        return 1 + static_cast<uint8_t>(key.ptr()[pos]);
+    }
+
+    /// Compare keys like strcmp(), knowing their first pos bytes are equal.
+    int compare_from(const T& a, const T& b, size_t pos) const
+    {
+        if(pos < 8)
+        {
+            const uint64_t pa = prefix_of(a);
+            const uint64_t pb = prefix_of(b);
+            if(pa != pb)
+            {
+                return pa < pb ? -1 : 1;
+            }
+            pos = 8;
+        }
+        const auto ka = key_of(a);
+        const auto kb = key_of(b);
+        const size_t size = std::min(ka.size(), kb.size());
+        const size_t offset = std::min(pos, size);
+        const int result = memcmp(ka.ptr() + offset, kb.ptr() + offset, size - offset);
+        if(result != 0)
+        {
+            return result;
+        }
+        return ka.size() < kb.size() ? -1 : ka.size() > kb.size() ? 1 : 0;
+    }
+
+    /// Remember a duplicate key; we only keep the smallest one.
+    void add_duplicate(const T& element)
+    {
+        if(!found_duplicate || compare_from(element, duplicate, 0) < 0)
+        {
+            duplicate       = element;
+            found_duplicate = true;
+        }
+    }
+
+    /// Insertion sort of keys with equal first pos bytes.
+    void insertion_sort(T* const data, const size_t count, const size_t pos)
+    {
+        for(size_t i = 1; i < count; ++i)
+        {
+            T element = data[i];
+            size_t j = i;
+            int cmp = 1;
+            for(; j > 0 && (cmp = compare_from(element, data[j - 1], pos)) < 0; --j)
+            {
+                data[j] = data[j - 1];
+            }
+            data[j] = element;
+            if(j > 0 && cmp == 0)
+            {
+                add_duplicate(element);
+            }
+        }
+    }
+
+    /// Sort keys with equal first pos bytes; buckets left to sort go to the work stack.
+    void sort_range(T* const data, const size_t count, size_t pos)
+    {
+        if(count <= INSERTION_SORT_MAX)
+        {
+            insertion_sort(data, count, pos);
+            return;
+        }
+
+        for(;; ++pos)
+        {
+            std::fill(starts, starts + BUCKETS + 1, 0);
+            for(size_t i = 0; i < count; ++i)
+            {
+                ++starts[bucket(data[i], pos) + 1];
+            }
+            // If all keys have the same byte, there's nothing to distribute.
+            if(starts[1] == 0 &&
+               std::find(starts + 2, starts + BUCKETS + 1, count) != starts + BUCKETS + 1)
+            {
+                continue;
+            }
+            break;
+        }
+        for(size_t b = 0; b < BUCKETS; ++b)
+        {
+            starts[b + 1] += starts[b];
+        }
+
+        std::copy(starts, starts + BUCKETS, fill);
+        for(size_t i = 0; i < count; ++i)
+        {
+            scratch[fill[bucket(data[i], pos)]++] = data[i];
+        }
+        std::copy(scratch.begin(), scratch.begin() + count, data);
+
+        // Keys in bucket 0 ended at pos, so they are all equal.
+        if(starts[1] > 1)
+        {
+            add_duplicate(data[1]);
+        }
+        for(size_t b = 1; b < BUCKETS; ++b)
+        {
+            if(starts[b + 1] - starts[b] > 1)
+            {
+                work.push_back(Range{data + starts[b], starts[b + 1] - starts[b], pos + 1});
+            }
+        }
+    }
+
+public:
+    StringSorter(const KeyOf& key_of, const PrefixOf& prefix_of)
+        : key_of(key_of)
+        , prefix_of(prefix_of)
+    {
+    }
+
+    /// Sort count elements.
+    void sort(T* const data, const size_t count)
+    {
+        scratch.resize(count);
+        work.push_back(Range{data, count, 0});
+        while(!work.empty())
+        {
+            const Range range = work.back();
+            work.pop_back();
+            sort_range(range.data, range.count, range.pos);
+        }
+    }
+
+    /// Get the smallest duplicate key found. Returns false if there are no duplicates.
+    bool get_duplicate(T& result) const
+    {
+        if(found_duplicate)
+        {
+            result = duplicate;
+        }
+        return found_duplicate;
+    }
+};
+
+/** Sort an array of elements by their string keys and find duplicate keys.
+ *
+ * Keys are ordered like compare() in cfg5-noalloc.h: memcmp() order, shorter first if one
+ * key is a prefix of the other.
+ *
+ * data      = Elements to sort.
+ * count     = Number of elements.
+ * key_of    = key_of(element) must return the element's key (something with ptr() and
+ *             size()).
+ * prefix_of = prefix_of(element) must return key_prefix() of the element's key (elements
+ *             usually store it so sorting doesn't need to read the keys).
+ * duplicate = If there are duplicate keys, an element with the smallest of them is
+ *             written here.
+ *
+ * Returns true if there are no duplicate keys, false otherwise.
+ */
+template<typename T, typename KeyOf, typename PrefixOf>
+bool string_sort(T* const data, const size_t count, const KeyOf& key_of,
+                 const PrefixOf& prefix_of, T& duplicate)
+{
+    StringSorter<T, KeyOf, PrefixOf> sorter(key_of, prefix_of);
+    sorter.sort(data, count);
+    return !sorter.get_duplicate(duplicate);
+}
+
+#endif /* end of include guard: STRING_SORT_H_QTRMBHVA */
@@ -30,6 +30,8 @@ commentchance = 30
 # seed = 42
 
 chars = "           \t\t\tabcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ-"
+# Array names (there can be at most 26 arrays per section)
+letters = "abcdefghijklmnopqrstuvwxyz"
 bools = ["yes", "true", "1", "no", "false", "0"]
 
 
@@ -145,7 +147,7 @@ def ini_multitag():
 def ini_section():
     if valtype[-1] == "s":
         for array in range(0, random.randint(minarrays, maxarrays)):
-            ini_array(chars[array])
+            ini_array(letters[array])
     elif valtype[-1] == "m":
         for multitag in range(0, random.randint(minarrays, maxarrays)):
             ini_multitag()
@@ -163,7 +165,7 @@ def ini_file(fname):
         newline()
         header(random_string(mintaglength, maxtaglength))
         ini_section()
-    else:
+    if sections == 0:
         newline()
         ini_section()
     with open(fname, "w") as inifile:
@@ -0,0 +1,305 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TRACE_EXPORT_H_BZMRXLCW
+#define TRACE_EXPORT_H_BZMRXLCW
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "diy.h"
+
+/** Writes zone records to a Chrome trace event JSON file; a ZoneCollector sink.
+ *
+ * The file can be opened in chrome://tracing or https://ui.perfetto.dev. Each zone is a
+ * complete ("X") event with its thread and depth; viewers nest zones of a thread by
+ * their times. Threads are named "thread N" in the order they recorded their first zone.
+ *
+ * Events are streamed: formatted into a fixed-size buffer, which is written to the file
+ * when full, so memory use doesn't grow with the number of events. Formatting is done by
+ * hand (no printf/iostream formatting) and zone names are escaped once per zone ID.
+ * As a sink, all of this runs on the collector thread, not in instrumented threads.
+ *
+ * Times are in microseconds since the writer was constructed (zones that started before
+ * that have negative times).
+ */
+class ChromeTraceWriter
+{
+private:
+    std::ofstream file;
+
+    // Formatted events not written to the file yet.
+    std::vector<char> buffer;
+    size_t used;
+
+    // Escaped JSON strings of zone names by zone ID; empty if not escaped yet.
+    std::vector<std::string> names;
+
+    // Threads whose names have been written.
+    std::vector<bool> named_threads;
+
+    // Nanoseconds of time 0 in the trace.
+    const uint64_t base_ns;
+
+    uint64_t events_;
+
+    // No event has been written yet.
+    bool empty;
+
+    bool finished;
+
+    /// Write the buffer to the file.
+    void flush()
+    {
+        file.write(buffer.data(), used);
+        used = 0;
+    }
+
+    /// Make sure the buffer has space for bytes more bytes.
+    void reserve(const size_t bytes)
+    {
+        if(used + bytes > buffer.size())
+        {
+            flush();
+            if(bytes > buffer.size())
+            {
+                buffer.resize(bytes);
+            }
+        }
+    }
+
+    /// Append a string. The buffer must have space for it.
+    void append(const char* const string, const size_t length)
+    {
+        memcpy(buffer.data() + used, string, length);
+        used += length;
+    }
+
+    template<size_t N>
+    void append(const char (&string)[N])
+    {
+        append(string, N - 1);
+    }
+
+    /// Append an unsigned integer, with at least min_digits digits (zero-padded).
+    void append_uint(uint64_t value, const unsigned min_digits = 1)
+    {
+        char digits[20];
+        unsigned count = 0;
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while(value != 0 || count < min_digits);
+        while(count > 0)
+        {
+            buffer[used++] = digits[--count];
+        }
+    }
+
+    /// Append nanoseconds as microseconds with 3 decimal places.
+    void append_usecs(const int64_t ns)
+    {
+        uint64_t abs_ns = static_cast<uint64_t>(ns);
+        if(ns < 0)
+        {
+            buffer[used++] = '-';
+            abs_ns = 0 - abs_ns;
+        }
+        append_uint(abs_ns / 1000);
+        buffer[used++] = '.';
+        append_uint(abs_ns % 1000, 3);
+    }
+
+    /// Get the escaped name of a zone.
+    const std::string& name(const ZoneId id)
+    {
+        if(id >= names.size())
+        {
+            names.resize(id + 1);
+        }
+        std::string& escaped = names[id];
+        if(!escaped.empty())
+        {
+            return escaped;
+        }
+        escaped.push_back('"');
+        for(const char* c = zone_name(id); *c != '\0'; ++c)
+        {
+            const unsigned char ch = static_cast<unsigned char>(*c);
+            if(ch == '"' || ch == '\\')
+            {
+                escaped.push_back('\\');
+                escaped.push_back(*c);
+            }
+            else if(ch < 0x20)
+            {
+                const char hex[] = "0123456789abcdef";
+                escaped += "\\u00";
+                escaped.push_back(hex[ch >> 4]);
+                escaped.push_back(hex[ch & 0xF]);
+            }
+            else
+            {
+                escaped.push_back(*c);
+            }
+        }
+        escaped.push_back('"');
+        return escaped;
+    }
+
+    /// Start a new event: separate it from the previous one.
+    void next_event()
+    {
+        if(!empty)
+        {
+            append(",\n");
+        }
+        empty = false;
+    }
+
+    /// Write a metadata event naming a thread.
+    void name_thread(const uint32_t thread)
+    {
+        named_threads.resize(thread + 1, false);
+        named_threads[thread] = true;
+        reserve(128);
+        next_event();
+        append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+        append_uint(thread);
+        append(",\"args\":{\"name\":\"thread ");
+        append_uint(thread);
+        append("\"}}");
+    }
+
+public:
+    /** Open a trace file.
+     *
+     * buffer_bytes = Size of the buffer for formatted events; the file is written in
+     *                blocks of this size.
+     */
+    explicit ChromeTraceWriter(const std::string& filename,
+                               const size_t buffer_bytes = 1 << 20)
+        : file(filename, std::ios::binary | std::ios::trunc)
+        , buffer(std::max<size_t>(buffer_bytes, 4096))
+        , used(0)
+        , base_ns(ticks_to_nsecs(zone_ticks()))
+        , events_(0)
+        , empty(true)
+        , finished(false)
+    {
+        append("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    }
+
+    ChromeTraceWriter(const ChromeTraceWriter&) = delete;
+    ChromeTraceWriter& operator=(const ChromeTraceWriter&) = delete;
+
+    ~ChromeTraceWriter() { finish(); }
+
+    /// Add records of finished zones of a thread.
+    void add(const uint32_t thread, const ZoneRecord* const records, const size_t count)
+    {
+        if(thread >= named_threads.size() || !named_threads[thread])
+        {
+            name_thread(thread);
+        }
+        for(size_t r = 0; r < count; ++r)
+        {
+            const ZoneRecord& record = records[r];
+            const std::string& zone  = name(record.zone);
+            const uint64_t start     = ticks_to_nsecs(record.start);
+            // An event without the name is less than 200 bytes.
+            reserve(zone.size() + 200);
+            next_event();
+            append("{\"name\":");
+            append(zone.data(), zone.size());
+            append(",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            append_uint(thread);
+            append(",\"ts\":");
+            append_usecs(static_cast<int64_t>(start - base_ns));
+            append(",\"dur\":");
+            append_usecs(static_cast<int64_t>(ticks_to_nsecs(record.end) - start));
+            append(",\"args\":{\"depth\":");
+            append_uint(record.depth);
+            append("}}");
+            ++events_;
+        }
+    }
+
+    /// A ZoneCollector sink writing records. The writer must outlive the collector.
+    ZoneCollector::Sink sink()
+    {
+        return [this](uint32_t thread, const ZoneRecord* records, size_t count)
+        {
+            add(thread, records, count);
+        };
+    }
+
+    /// Number of zone events written so far.
+    uint64_t events() const { return events_; }
+
+    /** Finish the JSON and close the file. Called by the destructor if not called.
+     *
+     * Returns false if the file could not be written.
+     */
+    bool finish()
+    {
+        if(!finished)
+        {
+            finished = true;
+            reserve(8);
+            append("\n]}\n");
+            flush();
+            file.close();
+        }
+        return !file.fail();
+    }
+};
+
+/** Records zones while it exists and writes them to a Chrome trace file.
+ *
+ * E.g. at the beginning of main():
+ *
+ *     TraceFile trace("trace.json");
+ *
+ * The file is complete once the TraceFile is destroyed. Only one may exist at a time (it
+ * has a ZoneCollector).
+ */
+class TraceFile
+{
+private:
+    ChromeTraceWriter writer;
+
+    ZoneCollector collector;
+
+public:
+    explicit TraceFile(const std::string& filename = "trace.json")
+        : writer(filename)
+        , collector(writer.sink())
+    {
+    }
+
+    ~TraceFile()
+    {
+        collector.stop();
+        if(!writer.finish())
+        {
+            std::cerr << "ERROR: Failed to write trace file" << std::endl;
+        }
+        if(collector.overflows() != 0)
+        {
+            std::cerr << collector.overflows() << " zones dropped by full zone buffers"
+                      << std::endl;
+        }
+    }
+};
+
+#endif /* end of include guard: TRACE_EXPORT_H_BZMRXLCW */
@@ -0,0 +1,148 @@
+//          Copyright Ferdinand Majerech 2014.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef TYPED_CACHE_H_RSUGKEVN
+#define TYPED_CACHE_H_RSUGKEVN
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "parse-value.h"
+
+/** Per-entry cache of values converted to int64_t, double and bool.
+ *
+ * Each value is converted on first access and remembered, including failed
+ * conversions, so repeated reads don't parse again. Slots are allocated on the first
+ * access to any value, so configs that are only read as strings pay nothing.
+ *
+ * Safe to use from multiple threads at once: slots are atomics, and if two threads
+ * convert the same value at the same time, both store the same result.
+ */
+class TypedCache
+{
+private:
+    // Flags of a slot: which conversions have been done, and their results.
+    enum Flags : uint8_t
+    {
+        INT_DONE     = 1,
+        INT_VALID    = 2,
+        DOUBLE_DONE  = 4,
+        DOUBLE_VALID = 8,
+        BOOL_DONE    = 16,
+        BOOL_VALID   = 32,
+        // The converted bool value itself.
+        BOOL_TRUE    = 64
+    };
+
+    struct Slot
+    {
+        std::atomic<uint8_t> flags;
+        std::atomic<int64_t> int_value;
+        std::atomic<double> double_value;
+    };
+
+    // Number of slots.
+    size_t count;
+
+    // Allocated on first access; see get_slots().
+    std::atomic<Slot*> slots;
+
+    /// Get the slots, allocating them (zeroed) if needed.
+    Slot* get_slots()
+    {
+        Slot* current = slots.load(std::memory_order_acquire);
+        if(current != nullptr)
+        {
+            return current;
+        }
+        Slot* const allocated = new Slot[count]();
+        if(slots.compare_exchange_strong(current, allocated, std::memory_order_acq_rel))
+        {
+            return allocated;
+        }
+        // Another thread was faster.
+        delete[] allocated;
+        return current;
+    }
+
+public:
+    /// Construct a cache for count values.
+    explicit TypedCache(const size_t count)
+        : count(count)
+        , slots(nullptr)
+    {
+    }
+
+    TypedCache(const TypedCache&) = delete;
+    TypedCache& operator=(const TypedCache&) = delete;
+
+    ~TypedCache()
+    {
+        delete[] slots.load();
+    }
+
+    /** Get value number index converted to an integer.
+     *
+     * data/size = The value as a string; only parsed on first access.
+     *
+     * Returns false if the value is not an integer (see parse_int()).
+     */
+    bool get(const size_t index, const char* const data, const size_t size, int64_t& result)
+    {
+        Slot& slot = get_slots()[index];
+        const uint8_t flags = slot.flags.load(std::memory_order_acquire);
+        if(flags & INT_DONE)
+        {
+            result = slot.int_value.load(std::memory_order_relaxed);
+            return (flags & INT_VALID) != 0;
+        }
+        const bool valid = parse_int(data, size, result);
+        slot.int_value.store(valid ? result : 0, std::memory_order_relaxed);
+        slot.flags.fetch_or(INT_DONE | (valid ? INT_VALID : 0), std::memory_order_release);
+        return valid;
+    }
+
+    /// Get value number index converted to a double. See get() for integers.
+    bool get(const size_t index, const char* const data, const size_t size, double& result)
+    {
+        Slot& slot = get_slots()[index];
+        const uint8_t flags = slot.flags.load(std::memory_order_acquire);
+        if(flags & DOUBLE_DONE)
+        {
+            result = slot.double_value.load(std::memory_order_relaxed);
+            return (flags & DOUBLE_VALID) != 0;
+        }
+        const bool valid = parse_double(data, size, result);
+        slot.double_value.store(valid ? result : 0.0, std::memory_order_relaxed);
+        slot.flags.fetch_or(DOUBLE_DONE | (valid ? DOUBLE_VALID : 0), std::memory_order_release);
+        return valid;
+    }
+
+    /// Get value number index converted to a bool. See get() for integers.
+    bool get(const size_t index, const char* const data, const size_t size, bool& result)
+    {
+        Slot& slot = get_slots()[index];
+        const uint8_t flags = slot.flags.load(std::memory_order_acquire);
+        if(flags & BOOL_DONE)
+        {
+            result = (flags & BOOL_TRUE) != 0;
+            return (flags & BOOL_VALID) != 0;
+        }
+        const bool valid = parse_bool(data, size, result);
+        const uint8_t done = BOOL_DONE | (valid ? BOOL_VALID : 0) |
+                             (valid && result ? BOOL_TRUE : 0);
+        slot.flags.fetch_or(done, std::memory_order_release);
+        return valid;
+    }
+
+    /// Size of allocated slots in bytes.
+    size_t bytes() const
+    {
+        return slots.load() == nullptr ? 0 : count * sizeof(Slot);
+    }
+};
+
+#endif /* end of include guard: TYPED_CACHE_H_RSUGKEVN */